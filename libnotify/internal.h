@@ -26,15 +26,112 @@
 #define NOTIFY_DBUS_CORE_INTERFACE "org.freedesktop.Notifications"
 #define NOTIFY_DBUS_CORE_OBJECT    "/org/freedesktop/Notifications"
 
+/*
+ * Vendor extension passing image pixels as a sealed memfd instead of in
+ * the message. Servers implementing it advertise the capability and
+ * accept the hint, of type (iiibiih): width, height, rowstride,
+ * has_alpha, bits_per_sample, channels and the handle of a file
+ * descriptor holding the pixels, laid out as for image-data.
+ */
+#define NOTIFY_IMAGE_FD_CAPABILITY "x-libnotify-image-fd"
+#define NOTIFY_IMAGE_FD_HINT       "x-libnotify-image-fd"
+
 G_BEGIN_DECLS
 
-GDBusProxy      * _notify_get_proxy                         (GError **error);
+GDBusConnection * _notify_get_connection                    (GError **error);
+void            _notify_get_connection_async                (GCancellable             *cancellable,
+                                                             GAsyncReadyCallback       callback,
+                                                             gpointer                  user_data);
+GDBusConnection * _notify_get_connection_finish             (GAsyncResult             *result,
+                                                             GError                  **error);
+
+gint            _notify_resolve_call_timeout                (gint                      timeout);
+GVariant        * _notify_call_sync                         (const char               *method,
+                                                             GVariant                 *parameters,
+                                                             const GVariantType       *reply_type,
+                                                             gint                      timeout,
+                                                             GCancellable             *cancellable,
+                                                             GError                  **error);
+void            _notify_call                                (const char               *method,
+                                                             GVariant                 *parameters,
+                                                             const GVariantType       *reply_type,
+                                                             gint                      timeout,
+                                                             GCancellable             *cancellable,
+                                                             GAsyncReadyCallback       callback,
+                                                             gpointer                  user_data);
+GVariant        * _notify_call_with_unix_fd_list_sync       (const char               *method,
+                                                             GVariant                 *parameters,
+                                                             GUnixFDList              *fd_list,
+                                                             const GVariantType       *reply_type,
+                                                             gint                      timeout,
+                                                             GCancellable             *cancellable,
+                                                             GError                  **error);
+void            _notify_call_with_unix_fd_list              (const char               *method,
+                                                             GVariant                 *parameters,
+                                                             GUnixFDList              *fd_list,
+                                                             const GVariantType       *reply_type,
+                                                             gint                      timeout,
+                                                             GCancellable             *cancellable,
+                                                             GAsyncReadyCallback       callback,
+                                                             gpointer                  user_data);
+GVariant        * _notify_call_finish                       (GAsyncResult             *result,
+                                                             GError                  **error);
+gboolean        _notify_server_has_image_fd                 (void);
 
 void            _notify_cache_add_notification              (NotifyNotification       *n);
 void            _notify_cache_remove_notification           (NotifyNotification       *n);
+void            _notify_register_notification               (NotifyNotification       *n,
+                                                             guint32                   id);
+void            _notify_unregister_notification             (NotifyNotification       *n,
+                                                             guint32                   id);
+void            _notify_set_signal_listener                 (NotifyNotification       *n,
+                                                             gboolean                  listening);
+void            _notify_update_signal_subscriptions         (void);
+gboolean        _notify_image_files_shown                   (void);
+void            _notify_image_files_closed                  (guint32                   id);
+void            _notify_image_files_forget                  (void);
+void            _notify_notification_emit_closed            (NotifyNotification       *n,
+                                                             guint32                   reason);
+void            _notify_notification_invoke_action          (NotifyNotification       *n,
+                                                             const char               *action);
+void            _notify_notification_send                   (NotifyNotification       *n);
+void            _notify_notification_flush_sync             (NotifyNotification       *n);
+GVariant       *_notify_notification_build_notify           (NotifyNotification       *n,
+                                                             GUnixFDList             **fd_list);
+void            _notify_notification_start_notify           (NotifyNotification       *n,
+                                                             GVariant                 *params,
+                                                             GUnixFDList              *fd_list,
+                                                             GCancellable             *cancellable,
+                                                             GAsyncReadyCallback       callback,
+                                                             gpointer                  user_data);
+void            _notify_notification_show_batched           (NotifyNotification       *n,
+                                                             GCancellable             *cancellable,
+                                                             GAsyncReadyCallback       callback,
+                                                             gpointer                  user_data);
+void            _notify_queue_notify                        (NotifyNotification       *n,
+                                                             GCancellable             *cancellable,
+                                                             GAsyncReadyCallback       callback,
+                                                             gpointer                  user_data);
+void            _notify_send_notify_now                     (NotifyNotification       *n,
+                                                             GCancellable             *cancellable,
+                                                             GAsyncReadyCallback       callback,
+                                                             gpointer                  user_data);
+NotifyUrgency   _notify_notification_get_urgency            (const NotifyNotification *n);
+const char     *_notify_notification_get_category           (const NotifyNotification *n);
 gint            _notify_notification_get_timeout            (const NotifyNotification *n);
 gboolean        _notify_notification_has_nondefault_actions (const NotifyNotification *n);
+GList          *_notify_notification_get_cache_link         (NotifyNotification       *n);
+NotifyNotification *_notify_pool_take                       (void);
+gboolean        _notify_pool_has_room                       (void);
+void            _notify_pool_keep                           (NotifyNotification       *n);
 gboolean        _notify_check_spec_version                  (int major, int minor);
+gboolean        _notify_rate_limit_admit                    (NotifyNotification       *n);
+void            _notify_rate_limit_forget                   (NotifyNotification       *n);
+gboolean        _notify_duplicates_enabled                  (void);
+gboolean        _notify_duplicates_check                    (GVariant                 *key,
+                                                             guint32                  *replaces_id);
+void            _notify_duplicates_sent                     (GVariant                 *key,
+                                                             guint32                   id);
 
 G_END_DECLS
 
@@ -23,8 +23,28 @@
 
 #include "config.h"
 
+#ifdef HAVE_MEMFD
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_MEMFD
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
+#ifdef HAVE_MEMFD
+#include <gio/gunixfdlist.h>
+#endif
+
 #include "notify.h"
 #include "internal.h"
 
@@ -52,20 +72,46 @@
 
 static void     notify_notification_class_init (NotifyNotificationClass *klass);
 static void     notify_notification_init       (NotifyNotification *sp);
+static void     notify_notification_dispose    (GObject            *object);
 static void     notify_notification_finalize   (GObject            *object);
 
+/* The parts of the Notify parameters that must be serialized again */
+enum
+{
+        NOTIFY_UPDATE_ACTIONS = 1 << 0,
+        NOTIFY_UPDATE_HINTS   = 1 << 1,
+        NOTIFY_UPDATE_IMAGE   = 1 << 2
+};
+
 typedef struct
 {
+        char                *id;
+        char                *label;
         NotifyActionCallback cb;
         GFreeFunc            free_func;
         gpointer             user_data;
 
-} CallbackPair;
+} NotifyAction;
+
+/* A hint; the key is interned, so equal keys are the same string */
+typedef struct
+{
+        const char     *key;
+        GVariant       *value;
+} NotifyHint;
+
+/* Hints sorted by key, allocated when the first one is set */
+typedef struct
+{
+        NotifyHint     *items;
+        guint           len;
+        guint           allocated;
+} NotifyHints;
 
 struct _NotifyNotificationPrivate
 {
         guint32         id;
-        char           *app_name;
+        const char     *app_name;      /* interned */
         char           *summary;
         char           *body;
 
@@ -79,16 +125,51 @@ struct _NotifyNotificationPrivate
          */
         gint            timeout;
 
-        GSList         *actions;
-        GHashTable     *action_map;
-        GHashTable     *hints;
+        /* Deadline of the requests sent for this notification */
+        gint            call_timeout;
+
+        /* NotifyActions, in the order they were added; NULL until the first */
+        GArray         *actions;
+
+        NotifyHints     hints;
+
+        /*
+         * Image set with notify_notification_set_image_from_pixbuf(), and
+         * the hint it was last sent in, NULL if none
+         */
+        GdkPixbuf      *image_pixbuf;
+        const char     *image_hint;
+
+        /* File the image was spilled to, see notify_set_image_spill_threshold() */
+        char           *image_file;
+
+        /* Image passed as a file descriptor, see NOTIFY_IMAGE_FD_HINT */
+        GdkPixbuf      *image_fd_pixbuf;
+
+        /* Serialized actions and hints, as of the last show */
+        GVariant       *actions_variant;
+        GVariant       *hints_variant;
 
         gboolean        has_nondefault_actions;
-        gboolean        updates_pending;
+        guint           updates_pending;
 
-        gulong          proxy_signal_handler;
+        /* Content of the notification being sent, to detect duplicates */
+        GVariant       *duplicate_key;
+
+        /* Live mode: minimum time between two Notify calls, in microseconds */
+        gint64          live_interval;
+        gint64          live_last_sent;
+        guint           live_source;
+        gboolean        live_in_flight;
+        gboolean        live_pending;
 
         gint            closed_reason;
+
+        /* Template created from, which owns the user data of its actions */
+        NotifyTemplate *tmpl;
+
+        /* Node in the list of active notifications kept by notify.c */
+        GList           cache_link;
 };
 
 enum
@@ -148,6 +229,7 @@ notify_notification_class_init (NotifyNotificationClass *klass)
         object_class->constructor = notify_notification_constructor;
         object_class->get_property = notify_notification_get_property;
         object_class->set_property = notify_notification_set_property;
+        object_class->dispose = notify_notification_dispose;
         object_class->finalize = notify_notification_finalize;
 
         /**
@@ -155,6 +237,10 @@ notify_notification_class_init (NotifyNotificationClass *klass)
 	 * @notification: The object which received the signal.
 	 *
 	 * Emitted when the notification is closed.
+	 *
+	 * libnotify only listens for the server closing a notification that
+	 * has actions or a handler for this signal at the time it is shown,
+	 * so connect to this signal before calling notify_notification_show().
 	 */
         signals[SIGNAL_CLOSED] =
                 g_signal_new ("closed",
@@ -248,6 +334,14 @@ notify_notification_update_internal (NotifyNotification *notification,
                                      const char         *body,
                                      const char         *icon);
 
+static void
+notify_notification_set_id (NotifyNotification *notification,
+                            guint32             id);
+static void
+notify_image_file_release (char *path);
+static const char *
+notify_image_get_checksum (GdkPixbuf *pixbuf);
+
 static void
 notify_notification_set_property (GObject      *object,
                                   guint         prop_id,
@@ -259,7 +353,7 @@ notify_notification_set_property (GObject      *object,
 
         switch (prop_id) {
         case PROP_ID:
-                priv->id = g_value_get_int (value);
+                notify_notification_set_id (notification, g_value_get_int (value));
                 break;
 
         case PROP_APP_NAME:
@@ -341,13 +435,213 @@ notify_notification_get_property (GObject    *object,
 }
 
 static void
-destroy_pair (CallbackPair *pair)
+notify_action_clear (NotifyAction *action)
+{
+        if (action->user_data != NULL && action->free_func != NULL) {
+                action->free_func (action->user_data);
+        }
+
+        g_free (action->id);
+        g_free (action->label);
+}
+
+/*
+ * Notifications have a few actions, so they are kept in a flat array
+ * that serializes straight into the Notify call and is searched in
+ * order.
+ */
+static NotifyAction *
+notify_actions_find (GArray     *actions,
+                     const char *id)
+{
+        NotifyAction *action;
+        guint         i;
+
+        for (i = 0; actions != NULL && i < actions->len; i++) {
+                action = &g_array_index (actions, NotifyAction, i);
+                if (strcmp (action->id, id) == 0)
+                        return action;
+        }
+
+        return NULL;
+}
+
+static GArray *
+notify_actions_new (void)
+{
+        GArray *actions;
+
+        actions = g_array_new (FALSE, FALSE, sizeof (NotifyAction));
+        g_array_set_clear_func (actions, (GDestroyNotify) notify_action_clear);
+
+        return actions;
+}
+
+/*
+ * Returns the entry for @id, emptied if there was one already, since
+ * adding an action again replaces it, or appended otherwise. Only its
+ * id is set.
+ */
+static NotifyAction *
+notify_actions_add (GArray     *actions,
+                    const char *id)
+{
+        NotifyAction *action;
+
+        action = notify_actions_find (actions, id);
+        if (action != NULL) {
+                notify_action_clear (action);
+        } else {
+                g_array_set_size (actions, actions->len + 1);
+                action = &g_array_index (actions, NotifyAction, actions->len - 1);
+        }
+
+        action->id = g_strdup (id);
+
+        return action;
+}
+
+/* Returns the actions as the "as" argument of Notify */
+static GVariant *
+notify_actions_serialize (GArray *actions)
+{
+        GVariantBuilder builder;
+        NotifyAction   *action;
+        guint           i;
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+        for (i = 0; actions != NULL && i < actions->len; i++) {
+                action = &g_array_index (actions, NotifyAction, i);
+                g_variant_builder_add (&builder, "s", action->id);
+                g_variant_builder_add (&builder, "s", action->label);
+        }
+
+        return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/*
+ * Hints are kept in an array sorted by key: notifications have a handful
+ * of them, so a binary search beats hashing and saves the table. Returns
+ * whether @key is set, and where it is or would be inserted.
+ */
+static gboolean
+notify_hints_find (const NotifyHints *hints,
+                   const char        *key,
+                   guint             *index)
+{
+        guint low = 0;
+        guint high = hints->len;
+        guint mid;
+        int   cmp;
+
+        while (low < high) {
+                mid = (low + high) / 2;
+                cmp = hints->items[mid].key == key ? 0 : strcmp (hints->items[mid].key, key);
+                if (cmp == 0) {
+                        *index = mid;
+                        return TRUE;
+                }
+
+                if (cmp < 0)
+                        low = mid + 1;
+                else
+                        high = mid;
+        }
+
+        *index = low;
+        return FALSE;
+}
+
+static GVariant *
+notify_hints_lookup (const NotifyHints *hints,
+                     const char        *key)
+{
+        guint index;
+
+        if (!notify_hints_find (hints, key, &index))
+                return NULL;
+
+        return hints->items[index].value;
+}
+
+static void
+notify_hints_reserve (NotifyHints *hints,
+                      guint        len)
+{
+        if (len <= hints->allocated)
+                return;
+
+        hints->allocated = MAX (MAX (4, hints->allocated * 2), len);
+        hints->items = g_renew (NotifyHint, hints->items, hints->allocated);
+}
+
+/* Sets @key to @value, taking ownership of it */
+static void
+notify_hints_insert (NotifyHints *hints,
+                     const char  *key,
+                     GVariant    *value)
+{
+        guint index;
+
+        if (notify_hints_find (hints, key, &index)) {
+                g_variant_unref (hints->items[index].value);
+                hints->items[index].value = value;
+                return;
+        }
+
+        notify_hints_reserve (hints, hints->len + 1);
+        memmove (&hints->items[index + 1],
+                 &hints->items[index],
+                 (hints->len - index) * sizeof (NotifyHint));
+        hints->items[index].key = g_intern_string (key);
+        hints->items[index].value = value;
+        hints->len++;
+}
+
+static gboolean
+notify_hints_remove (NotifyHints *hints,
+                     const char  *key)
+{
+        guint index;
+
+        if (!notify_hints_find (hints, key, &index))
+                return FALSE;
+
+        g_variant_unref (hints->items[index].value);
+        hints->len--;
+        memmove (&hints->items[index],
+                 &hints->items[index + 1],
+                 (hints->len - index) * sizeof (NotifyHint));
+
+        return TRUE;
+}
+
+/* Unsets all the hints, keeping the array for the next ones */
+static void
+notify_hints_clear (NotifyHints *hints)
+{
+        guint i;
+
+        for (i = 0; i < hints->len; i++)
+                g_variant_unref (hints->items[i].value);
+        hints->len = 0;
+}
+
+/* Returns the hints as the a{sv} argument of Notify */
+static GVariant *
+notify_hints_serialize (const NotifyHints *hints)
 {
-        if (pair->user_data != NULL && pair->free_func != NULL) {
-                pair->free_func (pair->user_data);
+        GVariantBuilder builder;
+        guint           i;
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+        for (i = 0; i < hints->len; i++) {
+                g_variant_builder_add (&builder, "{sv}",
+                                       hints->items[i].key,
+                                       hints->items[i].value);
         }
 
-        g_free (pair);
+        return g_variant_ref_sink (g_variant_builder_end (&builder));
 }
 
 static void
@@ -355,16 +649,28 @@ notify_notification_init (NotifyNotification *obj)
 {
         obj->priv = g_new0 (NotifyNotificationPrivate, 1);
         obj->priv->timeout = NOTIFY_EXPIRES_DEFAULT;
+        obj->priv->call_timeout = NOTIFY_CALL_TIMEOUT_DEFAULT;
         obj->priv->closed_reason = -1;
-        obj->priv->hints = g_hash_table_new_full (g_str_hash,
-                                                  g_str_equal,
-                                                  g_free,
-                                                  (GDestroyNotify) g_variant_unref);
+}
+
+static void
+notify_notification_dispose (GObject *object)
+{
+        /*
+         * A notification losing its last reference may be kept for reuse,
+         * see notify_set_notification_pool_size(). The reference the pool
+         * takes here keeps the object alive.
+         */
+        if (G_OBJECT_TYPE (object) == NOTIFY_TYPE_NOTIFICATION &&
+            object->ref_count == 1 &&
+            _notify_pool_has_room ()) {
+                G_OBJECT_CLASS (parent_class)->dispose (object);
+                notify_notification_reset (NOTIFY_NOTIFICATION (object));
+                _notify_pool_keep (NOTIFY_NOTIFICATION (object));
+                return;
+        }
 
-        obj->priv->action_map = g_hash_table_new_full (g_str_hash,
-                                                       g_str_equal,
-                                                       g_free,
-                                                       (GDestroyNotify) destroy_pair);
+        G_OBJECT_CLASS (parent_class)->dispose (object);
 }
 
 static void
@@ -372,30 +678,43 @@ notify_notification_finalize (GObject *object)
 {
         NotifyNotification        *obj = NOTIFY_NOTIFICATION (object);
         NotifyNotificationPrivate *priv = obj->priv;
-        GDBusProxy                *proxy;
 
         _notify_cache_remove_notification (obj);
 
-        g_free (priv->app_name);
+        if (priv->id != 0)
+                _notify_unregister_notification (obj, priv->id);
+        _notify_set_signal_listener (obj, FALSE);
+
         g_free (priv->summary);
         g_free (priv->body);
         g_free (priv->icon_name);
 
-        if (priv->actions != NULL) {
-                g_slist_foreach (priv->actions, (GFunc) g_free, NULL);
-                g_slist_free (priv->actions);
-        }
+        if (priv->actions != NULL)
+                g_array_unref (priv->actions);
 
-        if (priv->action_map != NULL)
-                g_hash_table_destroy (priv->action_map);
+        notify_hints_clear (&priv->hints);
+        g_free (priv->hints.items);
 
-        if (priv->hints != NULL)
-                g_hash_table_destroy (priv->hints);
+        if (priv->actions_variant != NULL)
+                g_variant_unref (priv->actions_variant);
 
-        proxy = _notify_get_proxy (NULL);
-        if (proxy != NULL && priv->proxy_signal_handler != 0) {
-                g_signal_handler_disconnect (proxy, priv->proxy_signal_handler);
-        }
+        if (priv->hints_variant != NULL)
+                g_variant_unref (priv->hints_variant);
+
+        if (priv->duplicate_key != NULL)
+                g_variant_unref (priv->duplicate_key);
+
+        if (priv->image_pixbuf != NULL)
+                g_object_unref (priv->image_pixbuf);
+
+        if (priv->image_file != NULL)
+                notify_image_file_release (priv->image_file);
+
+        if (priv->image_fd_pixbuf != NULL)
+                g_object_unref (priv->image_fd_pixbuf);
+
+        if (priv->tmpl != NULL)
+                notify_template_unref (priv->tmpl);
 
         g_free (obj->priv);
 
@@ -418,6 +737,18 @@ notify_notification_new (const char *summary,
                          const char *body,
                          const char *icon)
 {
+        NotifyNotification *notification;
+
+        notification = _notify_pool_take ();
+        if (notification != NULL) {
+                notify_notification_update_internal (notification,
+                                                     NULL,
+                                                     summary,
+                                                     body,
+                                                     icon);
+                return notification;
+        }
+
         return g_object_new (NOTIFY_TYPE_NOTIFICATION,
                              "summary", summary,
                              "body", body,
@@ -426,15 +757,12 @@ notify_notification_new (const char *summary,
 }
 
 static gchar *
-try_prepend_path (const char *base_path,
-                  const char *path)
+resolve_prepended_path (const char *base_path,
+                        const char *path)
 {
         gchar *path_filename;
         gchar *path_ret;
 
-        if (!path || *path == '\0')
-                return NULL;
-
         path_ret = NULL;
         path_filename = g_filename_from_uri (base_path, NULL, NULL);
 
@@ -452,21 +780,97 @@ try_prepend_path (const char *base_path,
 
         path_ret = g_build_filename (path, path_filename, NULL);
 
-        if (!g_file_test (path_ret, G_FILE_TEST_EXISTS)) {
-                g_free (path_ret);
-                path_ret = NULL;
-        }
-
         g_free (path_filename);
 
         return path_ret;
 }
 
+/*
+ * Looking for a file under a prefix costs a few system calls, and the
+ * icon is looked up again on every update. The results are cached by
+ * path for a couple of seconds, so a file that appears or goes away is
+ * noticed soon after, without a file monitor or a main loop. Relative
+ * paths are resolved against the working directory at the time they are
+ * first seen.
+ */
+#define NOTIFY_PATH_CACHE_SIZE 64
+#define NOTIFY_PATH_CACHE_TTL  (2 * G_USEC_PER_SEC)
+
+typedef struct
+{
+        char     *prefix;
+        char     *candidate;
+        gboolean  exists;
+        gint64    checked_at;
+} NotifyPathEntry;
+
+static GHashTable *_path_cache = NULL;
+
+static void
+notify_path_entry_free (NotifyPathEntry *entry)
+{
+        g_free (entry->prefix);
+        g_free (entry->candidate);
+        g_free (entry);
+}
+
+static gchar *
+try_prepend_path (const char *base_path,
+                  const char *path)
+{
+        NotifyPathEntry *entry;
+        gchar           *candidate;
+        gboolean         exists;
+        gint64           now;
+
+        if (!path || *path == '\0' || !base_path || *base_path == '\0')
+                return NULL;
+
+        if (_path_cache == NULL) {
+                _path_cache = g_hash_table_new_full (g_str_hash,
+                                                     g_str_equal,
+                                                     g_free,
+                                                     (GDestroyNotify) notify_path_entry_free);
+        }
+
+        now = g_get_monotonic_time ();
+
+        entry = g_hash_table_lookup (_path_cache, base_path);
+        if (entry != NULL &&
+            strcmp (entry->prefix, path) == 0 &&
+            now - entry->checked_at < NOTIFY_PATH_CACHE_TTL)
+                return entry->exists ? g_strdup (entry->candidate) : NULL;
+
+        candidate = resolve_prepended_path (base_path, path);
+        exists = g_file_test (candidate, G_FILE_TEST_EXISTS);
+
+        if (entry == NULL &&
+            g_hash_table_size (_path_cache) >= NOTIFY_PATH_CACHE_SIZE)
+                g_hash_table_remove_all (_path_cache);
+
+        entry = g_new (NotifyPathEntry, 1);
+        entry->prefix = g_strdup (path);
+        entry->candidate = g_strdup (candidate);
+        entry->exists = exists;
+        entry->checked_at = now;
+        g_hash_table_replace (_path_cache, g_strdup (base_path), entry);
+
+        if (!exists) {
+                g_free (candidate);
+                return NULL;
+        }
+
+        return candidate;
+}
+
 static gchar *
 try_prepend_desktop (const gchar *desktop)
 {
         gchar *ret;
 
+        if (desktop == NULL || *desktop == '\0')
+                return NULL;
+
         /*
          * if it's an absolute path, try prepending $SNAP, otherwise try
          * $SNAP_NAME_; snap .desktop files are in the format
@@ -500,9 +904,9 @@ notify_notification_update_internal (NotifyNotification *notification,
                                      const char         *body,
                                      const char         *icon)
 {
+        app_name = g_intern_string (app_name);
         if (notification->priv->app_name != app_name) {
-                g_free (notification->priv->app_name);
-                notification->priv->app_name = g_strdup (app_name);
+                notification->priv->app_name = app_name;
                 g_object_notify (G_OBJECT (notification), "app-name");
         }
 
@@ -533,8 +937,6 @@ notify_notification_update_internal (NotifyNotification *notification,
                 }
                 g_object_notify (G_OBJECT (notification), "icon-name");
         }
-
-        notification->priv->updates_pending = TRUE;
 }
 
 /**
@@ -567,178 +969,989 @@ notify_notification_update (NotifyNotification *notification,
         return TRUE;
 }
 
+/*
+ * notify_notification_set_id:
+ *
+ * Changes the server-side ID of @notification, keeping the ID → notification
+ * table used to dispatch the server signals in sync.
+ */
 static void
-proxy_g_signal_cb (GDBusProxy *proxy,
-                   const char *sender_name,
-                   const char *signal_name,
-                   GVariant   *parameters,
-                   NotifyNotification *notification)
+notify_notification_set_id (NotifyNotification *notification,
+                            guint32             id)
 {
-        g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
+        NotifyNotificationPrivate *priv = notification->priv;
 
-        if (g_strcmp0 (signal_name, "NotificationClosed") == 0 &&
-            g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(uu)"))) {
-                guint32 id, reason;
-
-                g_variant_get (parameters, "(uu)", &id, &reason);
-                if (id != notification->priv->id)
-                        return;
-
-                g_object_ref (G_OBJECT (notification));
-                notification->priv->closed_reason = reason;
-                g_signal_emit (notification, signals[SIGNAL_CLOSED], 0);
-                notification->priv->id = 0;
-                g_object_unref (G_OBJECT (notification));
-        } else if (g_strcmp0 (signal_name, "ActionInvoked") == 0 &&
-                   g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(us)"))) {
-                guint32 id;
-                const char *action;
-                CallbackPair *pair;
-
-                g_variant_get (parameters, "(u&s)", &id, &action);
-
-                if (id != notification->priv->id)
-                        return;
-
-                pair = (CallbackPair *) g_hash_table_lookup (notification->priv->action_map,
-                                                            action);
-
-                if (pair == NULL) {
-                        if (g_ascii_strcasecmp (action, "default")) {
-                                g_warning ("Received unknown action %s", action);
-                        }
-                } else {
-                        pair->cb (notification, (char *) action, pair->user_data);
-                }
-        }
+        if (priv->id == id)
+                return;
+
+        if (priv->id != 0)
+                _notify_unregister_notification (notification, priv->id);
+
+        priv->id = id;
+
+        if (priv->id != 0)
+                _notify_register_notification (notification, priv->id);
+        else
+                _notify_set_signal_listener (notification, FALSE);
 }
 
-/**
- * notify_notification_show:
- * @notification: The notification.
- * @error: The returned error information.
- *
- * Tells the notification server to display the notification on the screen.
- *
- * Returns: %TRUE if successful. On error, this will return %FALSE and set
- *          @error.
+/*
+ * Whether the NotificationClosed and ActionInvoked signals matter to
+ * @notification. The connection only subscribes to them while some live
+ * notification needs them, so processes that just fire notifications do
+ * not wake up whenever any application's notification goes away.
  */
-gboolean
-notify_notification_show (NotifyNotification *notification,
-                          GError            **error)
+static gboolean
+notify_notification_wants_signals (NotifyNotification *notification)
 {
-        NotifyNotificationPrivate *priv;
-        GDBusProxy                *proxy;
-        GVariantBuilder            actions_builder, hints_builder;
-        GSList                    *l;
-        GHashTableIter             iter;
-        gpointer                   key, data;
-        GVariant                  *result;
-
-        g_return_val_if_fail (notification != NULL, FALSE);
-        g_return_val_if_fail (NOTIFY_IS_NOTIFICATION (notification), FALSE);
-        g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-
-        if (!notify_is_initted ()) {
-                g_warning ("you must call notify_init() before showing");
-                g_assert_not_reached ();
-        }
+        if (notification->priv->actions != NULL &&
+            notification->priv->actions->len > 0)
+                return TRUE;
 
-        priv = notification->priv;
-        proxy = _notify_get_proxy (error);
-        if (proxy == NULL) {
-                return FALSE;
-        }
+        if (NOTIFY_NOTIFICATION_GET_CLASS (notification)->closed != NULL)
+                return TRUE;
 
-        if (priv->proxy_signal_handler == 0) {
-                priv->proxy_signal_handler = g_signal_connect (proxy,
-                                                               "g-signal",
-                                                               G_CALLBACK (proxy_g_signal_cb),
-                                                               notification);
-        }
-
-        g_variant_builder_init (&actions_builder, G_VARIANT_TYPE ("as"));
-        for (l = priv->actions; l != NULL; l = l->next) {
-                g_variant_builder_add (&actions_builder, "s", l->data);
-        }
-
-        g_variant_builder_init (&hints_builder, G_VARIANT_TYPE ("a{sv}"));
-        g_hash_table_iter_init (&iter, priv->hints);
-        while (g_hash_table_iter_next (&iter, &key, &data)) {
-                g_variant_builder_add (&hints_builder, "{sv}", key, data);
-        }
-
-        /* TODO: make this nonblocking */
-        result = g_dbus_proxy_call_sync (proxy,
-                                         "Notify",
-                                         g_variant_new ("(susssasa{sv}i)",
-                                                        priv->app_name ? priv->app_name : notify_get_app_name (),
-                                                        priv->id,
-                                                        priv->icon_name ? priv->icon_name : "",
-                                                        priv->summary ? priv->summary : "",
-                                                        priv->body ? priv->body : "",
-                                                        &actions_builder,
-                                                        &hints_builder,
-                                                        priv->timeout),
-                                         G_DBUS_CALL_FLAGS_NONE,
-                                         -1 /* FIXME ? */,
-                                         NULL,
-                                         error);
-        if (result == NULL) {
-                return FALSE;
-        }
-        if (!g_variant_is_of_type (result, G_VARIANT_TYPE ("(u)"))) {
-                g_variant_unref (result);
-                g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                             "Unexpected reply type");
-                return FALSE;
-        }
+        return g_signal_has_handler_pending (notification,
+                                             signals[SIGNAL_CLOSED],
+                                             0,
+                                             TRUE);
+}
 
-        g_variant_get (result, "(u)", &priv->id);
-        g_variant_unref (result);
+/*
+ * Subscribes before the Notify call is sent if needed, so that a signal
+ * for the new ID cannot be emitted before the bus routes it to us.
+ */
+static void
+notify_notification_listen_for_reply (NotifyNotification *notification)
+{
+        if (notify_notification_wants_signals (notification))
+                _notify_set_signal_listener (notification, TRUE);
+}
 
-        return TRUE;
+static void
+notify_notification_update_listener (NotifyNotification *notification)
+{
+        _notify_set_signal_listener (notification,
+                                     notification->priv->id != 0 &&
+                                     notify_notification_wants_signals (notification));
 }
 
-/**
- * notify_notification_set_timeout:
- * @notification: The notification.
- * @timeout: The timeout in milliseconds.
- *
- * Sets the timeout of the notification. To set the default time, pass
- * %NOTIFY_EXPIRES_DEFAULT as @timeout. To set the notification to never
- * expire, pass %NOTIFY_EXPIRES_NEVER.
- *
- * Note that the timeout may be ignored by the server.
- */
 void
-notify_notification_set_timeout (NotifyNotification *notification,
-                                 gint                timeout)
+_notify_notification_emit_closed (NotifyNotification *notification,
+                                  guint32             reason)
 {
-        g_return_if_fail (notification != NULL);
-        g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
+        guint32 id = notification->priv->id;
 
-        notification->priv->timeout = timeout;
+        g_object_ref (G_OBJECT (notification));
+        notification->priv->closed_reason = reason;
+        g_signal_emit (notification, signals[SIGNAL_CLOSED], 0);
+
+        /* A handler may have shown the notification again */
+        if (notification->priv->id == id)
+                notify_notification_set_id (notification, 0);
+
+        g_object_unref (G_OBJECT (notification));
 }
 
-gint
-_notify_notification_get_timeout (const NotifyNotification *notification)
+void
+_notify_notification_invoke_action (NotifyNotification *notification,
+                                    const char         *action)
 {
-        g_return_val_if_fail (notification != NULL, -1);
-        g_return_val_if_fail (NOTIFY_IS_NOTIFICATION (notification), -1);
+        NotifyAction *entry;
 
-        return notification->priv->timeout;
+        entry = notify_actions_find (notification->priv->actions, action);
+
+        if (entry == NULL) {
+                if (g_ascii_strcasecmp (action, "default")) {
+                        g_warning ("Received unknown action %s", action);
+                }
+        } else {
+                entry->cb (notification, (char *) action, entry->user_data);
+        }
 }
 
-/**
- * notify_notification_set_category:
- * @notification: The notification.
- * @category: The category.
+/*
+ * notify_notification_build_notify_params:
  *
- * Sets the category of this notification. This can be used by the
- * notification server to filter or display the data in a certain way.
+ * Builds the parameters of the Notify call. The actions and hints are
+ * only serialized again if they changed since the previous call; the
+ * cached #GVariants are reused otherwise.
  */
-void
+static void
+notify_notification_apply_image (NotifyNotification *notification);
+
+static void
+notify_notification_update_variants (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+
+        if (priv->updates_pending & NOTIFY_UPDATE_IMAGE)
+                notify_notification_apply_image (notification);
+
+        if (priv->actions_variant == NULL ||
+            (priv->updates_pending & NOTIFY_UPDATE_ACTIONS)) {
+                if (priv->actions_variant != NULL)
+                        g_variant_unref (priv->actions_variant);
+                priv->actions_variant = notify_actions_serialize (priv->actions);
+        }
+
+        if (priv->hints_variant == NULL ||
+            (priv->updates_pending & NOTIFY_UPDATE_HINTS)) {
+                if (priv->hints_variant != NULL)
+                        g_variant_unref (priv->hints_variant);
+                priv->hints_variant = notify_hints_serialize (&priv->hints);
+        }
+
+        priv->updates_pending = 0;
+}
+
+static GVariant *
+notify_notification_build_notify_params (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+
+        notify_notification_update_variants (notification);
+
+        return g_variant_new ("(susss@as@a{sv}i)",
+                              priv->app_name ? priv->app_name : notify_get_app_name (),
+                              priv->id,
+                              priv->icon_name ? priv->icon_name : "",
+                              priv->summary ? priv->summary : "",
+                              priv->body ? priv->body : "",
+                              priv->actions_variant,
+                              priv->hints_variant,
+                              priv->timeout);
+}
+
+#ifdef HAVE_MEMFD
+static int
+notify_image_get_fd (GdkPixbuf *pixbuf);
+#endif
+
+/*
+ * Returns the file descriptors the hints of @notification refer to, or
+ * %NULL if there are none.
+ */
+static GUnixFDList *
+notify_notification_build_fd_list (NotifyNotification *notification)
+{
+#ifdef HAVE_MEMFD
+        NotifyNotificationPrivate *priv = notification->priv;
+        GUnixFDList               *fd_list;
+        int                        fd;
+
+        if (priv->image_fd_pixbuf == NULL ||
+            notify_hints_lookup (&priv->hints, NOTIFY_IMAGE_FD_HINT) == NULL)
+                return NULL;
+
+        fd = notify_image_get_fd (priv->image_fd_pixbuf);
+        if (fd < 0)
+                return NULL;
+
+        /* Appended first, so the hint refers to it with handle 0 */
+        fd_list = g_unix_fd_list_new ();
+        if (g_unix_fd_list_append (fd_list, fd, NULL) < 0) {
+                g_object_unref (fd_list);
+                return NULL;
+        }
+
+        return fd_list;
+#else
+        return NULL;
+#endif
+}
+
+/*
+ * Returns %FALSE if @notification is a duplicate that must not be sent,
+ * as set with notify_set_duplicate_mode(). The key hashed is built from
+ * the serialized hints that are sent anyway.
+ */
+static gboolean
+notify_notification_check_duplicate (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+        GVariant                  *key;
+        guint32                    replaces_id;
+
+        if (!_notify_duplicates_enabled ())
+                return TRUE;
+
+        notify_notification_update_variants (notification);
+
+        /* An image passed as a file descriptor only has its size in the hints */
+        key = g_variant_ref_sink (g_variant_new ("(sss@a{sv}s)",
+                                                 priv->icon_name ? priv->icon_name : "",
+                                                 priv->summary ? priv->summary : "",
+                                                 priv->body ? priv->body : "",
+                                                 priv->hints_variant,
+                                                 priv->image_fd_pixbuf != NULL ?
+                                                 notify_image_get_checksum (priv->image_fd_pixbuf) : ""));
+
+        if (!_notify_duplicates_check (key, &replaces_id)) {
+                g_variant_unref (key);
+                return FALSE;
+        }
+
+        if (replaces_id != 0 && priv->id == 0)
+                notify_notification_set_id (notification, replaces_id);
+
+        if (priv->duplicate_key != NULL)
+                g_variant_unref (priv->duplicate_key);
+        priv->duplicate_key = key;
+
+        return TRUE;
+}
+
+static void
+notify_notification_duplicate_sent (NotifyNotification *notification,
+                                    guint32             id)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+
+        if (priv->duplicate_key == NULL)
+                return;
+
+        /* A notification that could not be sent was not seen */
+        if (id != 0)
+                _notify_duplicates_sent (priv->duplicate_key, id);
+        g_variant_unref (priv->duplicate_key);
+        priv->duplicate_key = NULL;
+}
+
+static void
+notify_image_file_shown (guint32     id,
+                         const char *path);
+
+static void
+notify_notification_handle_notify_reply (NotifyNotification *notification,
+                                         GVariant           *result)
+{
+        guint32 id;
+
+        g_variant_get (result, "(u)", &id);
+        g_variant_unref (result);
+
+        notify_notification_set_id (notification, id);
+        notify_notification_update_listener (notification);
+        notify_notification_duplicate_sent (notification, id);
+
+        if (notification->priv->image_file != NULL)
+                notify_image_file_shown (id, notification->priv->image_file);
+}
+
+static void
+notify_notification_schedule_flush (NotifyNotification *notification);
+
+static void
+notify_notification_live_send_done (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+
+        priv->live_in_flight = FALSE;
+
+        if (priv->live_pending) {
+                priv->live_pending = FALSE;
+                notify_notification_schedule_flush (notification);
+        }
+}
+
+static void
+notify_notification_send_cb (GObject      *source,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+        NotifyNotification *notification = NOTIFY_NOTIFICATION (user_data);
+        GVariant           *result;
+        GError             *error = NULL;
+
+        result = _notify_call_finish (res, &error);
+        if (result != NULL) {
+                notify_notification_handle_notify_reply (notification, result);
+        } else {
+                g_warning ("Failed to send a notification update: %s",
+                           error->message);
+                g_error_free (error);
+                notify_notification_update_listener (notification);
+                notify_notification_duplicate_sent (notification, 0);
+        }
+
+        notify_notification_live_send_done (notification);
+        g_object_unref (notification);
+}
+
+/*
+ * _notify_notification_send:
+ * @notification: a #NotifyNotification
+ *
+ * Sends @notification as it is now, in the background, for the updates
+ * libnotify defers on behalf of the application. Failures are logged.
+ * Duplicates are detected, and recorded once sent, as when showing.
+ */
+void
+_notify_notification_send (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+
+        if (!notify_notification_check_duplicate (notification))
+                return;
+
+        priv->live_last_sent = g_get_monotonic_time ();
+        priv->live_in_flight = TRUE;
+
+        _notify_queue_notify (notification,
+                              NULL,
+                              notify_notification_send_cb,
+                              g_object_ref (notification));
+}
+
+/*
+ * _notify_notification_build_notify:
+ * @notification: a #NotifyNotification
+ * @fd_list: (out): a location to store the file descriptors the
+ *   parameters refer to, or %NULL if there are none
+ *
+ * Builds the Notify call for @notification as it is now. The send queue
+ * does so when @notification is queued, right after its duplicate check,
+ * so that both see the same content however long it waits.
+ *
+ * Returns: (transfer full): the parameters of the Notify call
+ */
+GVariant *
+_notify_notification_build_notify (NotifyNotification *notification,
+                                   GUnixFDList       **fd_list)
+{
+        *fd_list = notify_notification_build_fd_list (notification);
+
+        return g_variant_ref_sink (notify_notification_build_notify_params (notification));
+}
+
+/*
+ * _notify_notification_start_notify:
+ * @notification: a #NotifyNotification
+ * @params: the parameters built by _notify_notification_build_notify()
+ * @fd_list: (allow-none): the file descriptors built with them
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback, finishing with _notify_call_finish()
+ * @user_data: the data to pass to @callback
+ *
+ * Sends the Notify call for @notification. Called by the send queue when
+ * the turn of @notification comes.
+ */
+void
+_notify_notification_start_notify (NotifyNotification *notification,
+                                   GVariant           *params,
+                                   GUnixFDList        *fd_list,
+                                   GCancellable       *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer            user_data)
+{
+        notify_notification_listen_for_reply (notification);
+
+        _notify_call_with_unix_fd_list ("Notify",
+                                        params,
+                                        fd_list,
+                                        G_VARIANT_TYPE ("(u)"),
+                                        notification->priv->call_timeout,
+                                        cancellable,
+                                        callback,
+                                        user_data);
+}
+
+static gboolean
+notify_notification_flush (gpointer user_data)
+{
+        NotifyNotification *notification = NOTIFY_NOTIFICATION (user_data);
+
+        notification->priv->live_source = 0;
+
+        /* The merged update needs a token like any other show */
+        if (!_notify_rate_limit_admit (notification))
+                return FALSE;
+
+        /* Whatever the notification looks like now is the merged state */
+        _notify_notification_send (notification);
+
+        return FALSE;
+}
+
+static void
+notify_notification_schedule_flush (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+        gint64                     delay;
+
+        if (priv->live_source != 0)
+                return;
+
+        delay = priv->live_last_sent + priv->live_interval - g_get_monotonic_time ();
+        delay = MAX (delay, 0);
+
+        priv->live_source = g_timeout_add_full (G_PRIORITY_DEFAULT,
+                                                (guint) ((delay + 999) / 1000),
+                                                notify_notification_flush,
+                                                g_object_ref (notification),
+                                                g_object_unref);
+}
+
+static void
+notify_notification_cancel_flush (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+
+        priv->live_pending = FALSE;
+
+        if (priv->live_source != 0) {
+                g_source_remove (priv->live_source);
+                priv->live_source = 0;
+        }
+}
+
+/*
+ * Returns %TRUE if showing @notification now would exceed the rate set
+ * with notify_notification_set_max_update_rate(). The update is then
+ * sent later on, together with any that follow it in the meantime.
+ */
+static gboolean
+notify_notification_defer_show (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+        gint64                     now;
+
+        if (priv->live_interval == 0)
+                return FALSE;
+
+        if (priv->live_source != 0)
+                return TRUE;
+
+        if (priv->live_in_flight) {
+                priv->live_pending = TRUE;
+                return TRUE;
+        }
+
+        now = g_get_monotonic_time ();
+        if (priv->live_last_sent != 0 &&
+            now < priv->live_last_sent + priv->live_interval) {
+                notify_notification_schedule_flush (notification);
+                return TRUE;
+        }
+
+        priv->live_last_sent = now;
+
+        return FALSE;
+}
+
+static gboolean
+notify_notification_send_sync (NotifyNotification *notification,
+                               GError            **error);
+
+/**
+ * notify_notification_show:
+ * @notification: The notification.
+ * @error: The returned error information.
+ *
+ * Tells the notification server to display the notification on the screen.
+ *
+ * Returns: %TRUE if successful. On error, this will return %FALSE and set
+ *          @error.
+ */
+gboolean
+notify_notification_show (NotifyNotification *notification,
+                          GError            **error)
+{
+        g_return_val_if_fail (notification != NULL, FALSE);
+        g_return_val_if_fail (NOTIFY_IS_NOTIFICATION (notification), FALSE);
+        g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+        if (!notify_is_initted ()) {
+                g_warning ("you must call notify_init() before showing");
+                g_assert_not_reached ();
+        }
+
+        /* This blocks anyway, and tells which image hint the server wants */
+        if (_notify_get_connection (error) == NULL)
+                return FALSE;
+
+        if (notify_notification_defer_show (notification) ||
+            !_notify_rate_limit_admit (notification) ||
+            !notify_notification_check_duplicate (notification))
+                return TRUE;
+
+        return notify_notification_send_sync (notification, error);
+}
+
+/* Sends the Notify call for @notification as it is now, and waits for the reply */
+static gboolean
+notify_notification_send_sync (NotifyNotification *notification,
+                               GError            **error)
+{
+        GVariant                  *result;
+        GUnixFDList               *fd_list;
+
+        notify_notification_listen_for_reply (notification);
+
+        fd_list = notify_notification_build_fd_list (notification);
+        result = _notify_call_with_unix_fd_list_sync ("Notify",
+                                                      notify_notification_build_notify_params (notification),
+                                                      fd_list,
+                                                      G_VARIANT_TYPE ("(u)"),
+                                                      notification->priv->call_timeout,
+                                                      NULL,
+                                                      error);
+        if (fd_list != NULL)
+                g_object_unref (fd_list);
+
+        if (result == NULL) {
+                notify_notification_update_listener (notification);
+                notify_notification_duplicate_sent (notification, 0);
+                return FALSE;
+        }
+
+        notify_notification_handle_notify_reply (notification, result);
+
+        return TRUE;
+}
+
+static void
+notify_notification_show_cb (GObject      *source,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+        GTask              *task = G_TASK (user_data);
+        NotifyNotification *notification = g_task_get_source_object (task);
+        GVariant           *result;
+        GError             *error = NULL;
+
+        result = _notify_call_finish (res, &error);
+        if (result != NULL) {
+                notify_notification_handle_notify_reply (notification, result);
+                g_task_return_boolean (task, TRUE);
+        } else {
+                notify_notification_update_listener (notification);
+                notify_notification_duplicate_sent (notification, 0);
+                g_task_return_error (task, error);
+        }
+
+        notify_notification_live_send_done (notification);
+        g_object_unref (task);
+}
+
+static void
+notify_notification_show_async_internal (NotifyNotification *notification,
+                                         gboolean            batched,
+                                         GCancellable       *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer            user_data)
+{
+        GTask      *task;
+
+        g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
+        g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+        if (!notify_is_initted ()) {
+                g_warning ("you must call notify_init() before showing");
+                g_assert_not_reached ();
+        }
+
+        task = g_task_new (notification, cancellable, callback, user_data);
+        g_task_set_source_tag (task, notify_notification_show_async);
+
+        if (notify_notification_defer_show (notification) ||
+            !_notify_rate_limit_admit (notification) ||
+            !notify_notification_check_duplicate (notification)) {
+                g_task_return_boolean (task, TRUE);
+                g_object_unref (task);
+                return;
+        }
+
+        notification->priv->live_in_flight = notification->priv->live_interval > 0;
+
+        if (batched) {
+                _notify_send_notify_now (notification,
+                                         cancellable,
+                                         notify_notification_show_cb,
+                                         task);
+        } else {
+                _notify_queue_notify (notification,
+                                      cancellable,
+                                      notify_notification_show_cb,
+                                      task);
+        }
+}
+
+/**
+ * notify_notification_show_async:
+ * @notification: The notification.
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the
+ *            notification has been shown
+ * @user_data: (closure): the data to pass to @callback
+ *
+ * Asynchronously tells the notification server to display the notification
+ * on the screen. This is the non-blocking version of
+ * notify_notification_show().
+ *
+ * When the operation is finished, @callback will be called. You can then
+ * call notify_notification_show_finish() to get the result of the
+ * operation. The notification ID is updated before @callback is invoked.
+ *
+ * Notifications shown this way go through a send queue ordered by their
+ * urgency, so a critical notification overtakes the less urgent ones still
+ * waiting to be sent. If the queue is full, see
+ * notify_set_send_queue_depth(), the operation fails with
+ * %G_IO_ERROR_WOULD_BLOCK and the application should back off.
+ *
+ * Since: 0.8
+ */
+void
+notify_notification_show_async (NotifyNotification *notification,
+                                GCancellable       *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer            user_data)
+{
+        notify_notification_show_async_internal (notification,
+                                                 FALSE,
+                                                 cancellable,
+                                                 callback,
+                                                 user_data);
+}
+
+/*
+ * _notify_notification_show_batched:
+ *
+ * Like notify_notification_show_async(), for notify_show_many(): the
+ * Notify call is sent at once, however many calls already await their
+ * reply, so that a whole batch is written before any reply is waited for.
+ */
+void
+_notify_notification_show_batched (NotifyNotification *notification,
+                                   GCancellable       *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer            user_data)
+{
+        notify_notification_show_async_internal (notification,
+                                                 TRUE,
+                                                 cancellable,
+                                                 callback,
+                                                 user_data);
+}
+
+/**
+ * notify_notification_show_finish:
+ * @notification: The notification.
+ * @result: the #GAsyncResult passed to the callback
+ * @error: The returned error information.
+ *
+ * Finishes an operation started with notify_notification_show_async().
+ *
+ * Returns: %TRUE if successful. On error, this will return %FALSE and set
+ *          @error.
+ *
+ * Since: 0.8
+ */
+gboolean
+notify_notification_show_finish (NotifyNotification *notification,
+                                 GAsyncResult       *result,
+                                 GError            **error)
+{
+        g_return_val_if_fail (NOTIFY_IS_NOTIFICATION (notification), FALSE);
+        g_return_val_if_fail (g_task_is_valid (result, notification), FALSE);
+        g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+        return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * notify_notification_set_max_update_rate:
+ * @notification: The notification.
+ * @rate: the maximum number of updates sent per second, or 0 for no limit
+ *
+ * Puts @notification in live mode, for progress or status notifications
+ * that are updated and shown again many times per second.
+ *
+ * In live mode, notify_notification_show() sends the notification right
+ * away only if the previous update was sent long enough ago. Otherwise it
+ * returns %TRUE immediately and the notification is sent from the main
+ * loop once the interval has passed, as it is at that time. All updates
+ * made in between are thus merged, and the server receives at most @rate
+ * updates per second however often the notification is shown. Errors
+ * sending a deferred update are logged. A pending update is also sent
+ * right away by notify_notification_close() and notify_uninit(), so it
+ * is not lost if the main loop does not run again.
+ *
+ * Passing 0 leaves live mode, sending any pending update at once.
+ *
+ * Since: 0.8
+ */
+void
+notify_notification_set_max_update_rate (NotifyNotification *notification,
+                                         guint               rate)
+{
+        NotifyNotificationPrivate *priv;
+
+        g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
+
+        priv = notification->priv;
+        priv->live_interval = rate > 0 ? G_USEC_PER_SEC / rate : 0;
+
+        if (rate == 0 && priv->live_source != 0) {
+                g_source_remove (priv->live_source);
+                notify_notification_flush (notification);
+        }
+}
+
+/*
+ * _notify_notification_flush_sync:
+ * @notification: a #NotifyNotification
+ *
+ * Sends the update held back by the live mode, if any, and waits for the
+ * reply. Deferred updates are otherwise sent from the main loop, which
+ * callers closing @notification or uninitializing libnotify may not run
+ * again.
+ */
+void
+_notify_notification_flush_sync (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+        GError                    *error = NULL;
+
+        /*
+         * An update waiting for the previous one to be answered can only
+         * be sent without it if the server already gave the ID to replace.
+         */
+        if (priv->live_source == 0 &&
+            !(priv->live_pending && priv->id != 0))
+                return;
+
+        notify_notification_cancel_flush (notification);
+
+        if (!_notify_rate_limit_admit (notification) ||
+            !notify_notification_check_duplicate (notification))
+                return;
+
+        priv->live_last_sent = g_get_monotonic_time ();
+
+        if (!notify_notification_send_sync (notification, &error)) {
+                g_warning ("Failed to send a notification update: %s",
+                           error->message);
+                g_error_free (error);
+        }
+}
+
+/**
+ * notify_notification_reset:
+ * @notification: The notification.
+ *
+ * Returns @notification to the state of a new notification without a
+ * summary, so that it can be reused for another notification. The
+ * memory it allocated for hints and actions is kept.
+ *
+ * The summary, body, icon, application name, hints, actions, image,
+ * timeouts and update rate are cleared. A notification being shown is
+ * forgotten rather than closed: showing @notification again displays a
+ * new notification. Signal handlers are kept.
+ *
+ * Since: 0.8
+ */
+void
+notify_notification_reset (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv;
+
+        g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
+
+        priv = notification->priv;
+
+        g_object_freeze_notify (G_OBJECT (notification));
+
+        notify_notification_cancel_flush (notification);
+        _notify_rate_limit_forget (notification);
+
+        if (priv->id != 0) {
+                notify_notification_set_id (notification, 0);
+                g_object_notify (G_OBJECT (notification), "id");
+        }
+        _notify_set_signal_listener (notification, FALSE);
+
+        notify_notification_update_internal (notification, NULL, NULL, NULL, NULL);
+        notify_notification_clear_hints (notification);
+        notify_notification_clear_actions (notification);
+
+        /* The actions borrowing its user data are gone */
+        if (priv->tmpl != NULL) {
+                notify_template_unref (priv->tmpl);
+                priv->tmpl = NULL;
+        }
+
+        if (priv->image_file != NULL) {
+                notify_image_file_release (priv->image_file);
+                priv->image_file = NULL;
+        }
+
+        if (priv->image_fd_pixbuf != NULL) {
+                g_object_unref (priv->image_fd_pixbuf);
+                priv->image_fd_pixbuf = NULL;
+        }
+
+        if (priv->duplicate_key != NULL) {
+                g_variant_unref (priv->duplicate_key);
+                priv->duplicate_key = NULL;
+        }
+
+        priv->timeout = NOTIFY_EXPIRES_DEFAULT;
+        priv->call_timeout = NOTIFY_CALL_TIMEOUT_DEFAULT;
+        priv->live_interval = 0;
+        priv->live_last_sent = 0;
+        priv->live_in_flight = FALSE;
+        priv->closed_reason = -1;
+
+        g_object_thaw_notify (G_OBJECT (notification));
+}
+
+/**
+ * notify_notification_set_timeout:
+ * @notification: The notification.
+ * @timeout: The timeout in milliseconds.
+ *
+ * Sets the timeout of the notification. To set the default time, pass
+ * %NOTIFY_EXPIRES_DEFAULT as @timeout. To set the notification to never
+ * expire, pass %NOTIFY_EXPIRES_NEVER.
+ *
+ * Note that the timeout may be ignored by the server.
+ */
+void
+notify_notification_set_timeout (NotifyNotification *notification,
+                                 gint                timeout)
+{
+        g_return_if_fail (notification != NULL);
+        g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
+
+        notification->priv->timeout = timeout;
+}
+
+/**
+ * notify_notification_set_call_timeout:
+ * @notification: The notification.
+ * @timeout: the deadline in milliseconds, or %NOTIFY_CALL_TIMEOUT_DEFAULT
+ *
+ * Sets how long to wait for the notification server to answer when this
+ * notification is shown or closed, overriding notify_set_call_timeout().
+ * Pass %NOTIFY_CALL_TIMEOUT_DEFAULT to use the global deadline again.
+ *
+ * This is unrelated to notify_notification_set_timeout(), which controls
+ * how long the notification stays on screen.
+ *
+ * Since: 0.8
+ */
+void
+notify_notification_set_call_timeout (NotifyNotification *notification,
+                                      gint                timeout)
+{
+        g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
+        g_return_if_fail (timeout > 0 || timeout == NOTIFY_CALL_TIMEOUT_DEFAULT);
+
+        notification->priv->call_timeout = timeout;
+}
+
+NotifyUrgency
+_notify_notification_get_urgency (const NotifyNotification *notification)
+{
+        GVariant *urgency;
+
+        urgency = notify_hints_lookup (&notification->priv->hints, "urgency");
+        if (urgency == NULL ||
+            !g_variant_is_of_type (urgency, G_VARIANT_TYPE_BYTE))
+                return NOTIFY_URGENCY_NORMAL;
+
+        return MIN (g_variant_get_byte (urgency), NOTIFY_URGENCY_CRITICAL);
+}
+
+const char *
+_notify_notification_get_category (const NotifyNotification *notification)
+{
+        GVariant *category;
+
+        category = notify_hints_lookup (&notification->priv->hints, "category");
+        if (category == NULL ||
+            !g_variant_is_of_type (category, G_VARIANT_TYPE_STRING))
+                return NULL;
+
+        return g_variant_get_string (category, NULL);
+}
+
+gint
+_notify_notification_get_timeout (const NotifyNotification *notification)
+{
+        g_return_val_if_fail (notification != NULL, -1);
+        g_return_val_if_fail (NOTIFY_IS_NOTIFICATION (notification), -1);
+
+        return notification->priv->timeout;
+}
+
+/*
+ * Hint values that come from a small set are shared by all the
+ * notifications of the process, so that setting them does not allocate.
+ * They are never freed.
+ */
+static GVariant *
+notify_shared_urgency (NotifyUrgency urgency)
+{
+        static GVariant *values[NOTIFY_URGENCY_CRITICAL + 1];
+
+        if (values[urgency] == NULL)
+                values[urgency] = g_variant_ref_sink (g_variant_new_byte ((guchar) urgency));
+
+        return values[urgency];
+}
+
+static GVariant *
+notify_shared_category (const char *category)
+{
+        static GHashTable *values = NULL;
+        GVariant          *value;
+
+        category = g_intern_string (category);
+
+        if (values == NULL)
+                values = g_hash_table_new (NULL, NULL);
+
+        value = g_hash_table_lookup (values, category);
+        if (value == NULL) {
+                value = g_variant_ref_sink (g_variant_new_string (category));
+                g_hash_table_insert (values, (gpointer) category, value);
+        }
+
+        return value;
+}
+
+/* Takes a reference on @value and returns one on a shared equal value */
+static GVariant *
+notify_share_hint_value (GVariant *value)
+{
+        static GVariant *booleans[2];
+        gboolean         b;
+
+        if (!g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+                return value;
+
+        /* transient, resident, action-icons, suppress-sound... */
+        b = g_variant_get_boolean (value) != FALSE;
+        if (booleans[b] == NULL)
+                booleans[b] = g_variant_ref_sink (g_variant_new_boolean (b));
+
+        g_variant_unref (value);
+
+        return g_variant_ref (booleans[b]);
+}
+
+/**
+ * notify_notification_set_category:
+ * @notification: The notification.
+ * @category: The category.
+ *
+ * Sets the category of this notification. This can be used by the
+ * notification server to filter or display the data in a certain way.
+ */
+void
 notify_notification_set_category (NotifyNotification *notification,
                                   const char         *category)
 {
@@ -746,9 +1959,10 @@ notify_notification_set_category (NotifyNotification *notification,
         g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
 
         if (category != NULL && category[0] != '\0') {
-                notify_notification_set_hint_string (notification,
-                                                     "category",
-                                                     category);
+                notify_hints_insert (&notification->priv->hints,
+                                     "category",
+                                     g_variant_ref (notify_shared_category (category)));
+                notification->priv->updates_pending |= NOTIFY_UPDATE_HINTS;
         }
 }
 
@@ -768,25 +1982,677 @@ notify_notification_set_urgency (NotifyNotification *notification,
         g_return_if_fail (notification != NULL);
         g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
 
-        notify_notification_set_hint_byte (notification,
-                                           "urgency",
-                                           (guchar) urgency);
-}
+        if (urgency > NOTIFY_URGENCY_CRITICAL) {
+                notify_notification_set_hint_byte (notification,
+                                                   "urgency",
+                                                   (guchar) urgency);
+                return;
+        }
+
+        notify_hints_insert (&notification->priv->hints,
+                             "urgency",
+                             g_variant_ref (notify_shared_urgency (urgency)));
+        notification->priv->updates_pending |= NOTIFY_UPDATE_HINTS;
+}
+
+/**
+ * notify_notification_set_icon_from_pixbuf:
+ * @notification: The notification.
+ * @icon: The icon.
+ *
+ * Sets the icon in the notification from a #GdkPixbuf.
+ * Deprecated: use notify_notification_set_image_from_pixbuf() instead.
+ *
+ */
+void
+notify_notification_set_icon_from_pixbuf (NotifyNotification *notification,
+                                          GdkPixbuf          *icon)
+{
+        notify_notification_set_image_from_pixbuf (notification, icon);
+}
+
+static G_DEFINE_QUARK (notify-scaled-image, notify_scaled_image)
+
+/*
+ * Returns @pixbuf downscaled to fit within notify_get_max_image_size(),
+ * or @pixbuf itself if it already fits. The scaled copy is kept on
+ * @pixbuf, so that showing the same image again does not scale it again.
+ */
+static GdkPixbuf *
+notify_notification_scale_image (GdkPixbuf *pixbuf)
+{
+        GdkPixbuf *scaled;
+        gint       max_size = (gint) MIN (notify_get_max_image_size (), G_MAXINT);
+        gint       width = gdk_pixbuf_get_width (pixbuf);
+        gint       height = gdk_pixbuf_get_height (pixbuf);
+        gint       scaled_width;
+        gint       scaled_height;
+
+        if (max_size == 0 || (width <= max_size && height <= max_size))
+                return g_object_ref (pixbuf);
+
+        if (width >= height) {
+                scaled_width = max_size;
+                scaled_height = MAX (1, (gint) ((gint64) height * max_size / width));
+        } else {
+                scaled_width = MAX (1, (gint) ((gint64) width * max_size / height));
+                scaled_height = max_size;
+        }
+
+        scaled = g_object_get_qdata (G_OBJECT (pixbuf), notify_scaled_image_quark ());
+        if (scaled != NULL &&
+            gdk_pixbuf_get_width (scaled) == scaled_width &&
+            gdk_pixbuf_get_height (scaled) == scaled_height)
+                return g_object_ref (scaled);
+
+        scaled = gdk_pixbuf_scale_simple (pixbuf,
+                                          scaled_width,
+                                          scaled_height,
+                                          GDK_INTERP_BILINEAR);
+        if (scaled == NULL)
+                return g_object_ref (pixbuf);
+
+        g_object_set_qdata_full (G_OBJECT (pixbuf),
+                                 notify_scaled_image_quark (),
+                                 g_object_ref (scaled),
+                                 g_object_unref);
+
+        return scaled;
+}
+
+/*
+ * Serialized images are shared by all the notifications of the process,
+ * so that attaching the same logo to every notification serializes it
+ * once. The cache holds a reference on each image, most recently used
+ * first, and drops the least recently used ones above its budget.
+ */
+#define NOTIFY_IMAGE_CACHE_BUDGET (4 * 1024 * 1024)
+
+typedef struct
+{
+        guint         hash;
+        gint          width;
+        gint          height;
+        gint          rowstride;
+        gint          bits_per_sample;
+        gint          n_channels;
+        gboolean      has_alpha;
+        const guchar *pixels;
+        gsize         len;
+
+        /* The (iiibii@ay) hint value; unset in lookup keys */
+        GVariant     *value;
+        GList         link;
+} NotifyImage;
+
+static GHashTable *_image_cache = NULL;
+static GQueue      _image_cache_lru = G_QUEUE_INIT;
+static gsize       _image_cache_size = 0;
+
+static guint
+notify_image_hash (gconstpointer key)
+{
+        return ((const NotifyImage *) key)->hash;
+}
+
+static gboolean
+notify_image_equal (gconstpointer a,
+                    gconstpointer b)
+{
+        const NotifyImage *image_a = a;
+        const NotifyImage *image_b = b;
+
+        return image_a->width == image_b->width &&
+               image_a->height == image_b->height &&
+               image_a->rowstride == image_b->rowstride &&
+               image_a->bits_per_sample == image_b->bits_per_sample &&
+               image_a->n_channels == image_b->n_channels &&
+               image_a->has_alpha == image_b->has_alpha &&
+               image_a->len == image_b->len &&
+               memcmp (image_a->pixels, image_b->pixels, image_a->len) == 0;
+}
+
+static void
+notify_image_cache_evict (NotifyImage *keep)
+{
+        NotifyImage *image;
+
+        while (_image_cache_size > NOTIFY_IMAGE_CACHE_BUDGET &&
+               _image_cache_lru.tail != &keep->link) {
+                image = _image_cache_lru.tail->data;
+
+                g_queue_unlink (&_image_cache_lru, &image->link);
+                g_hash_table_remove (_image_cache, image);
+                _image_cache_size -= image->len;
+
+                /* Notifications using the image keep their own reference */
+                g_variant_unref (image->value);
+                g_free (image);
+        }
+}
+
+/*
+ * Returns the image-data hint value for @pixbuf, sharing it with any
+ * other notification showing the same pixels.
+ */
+static GVariant *
+notify_image_cache_lookup (GdkPixbuf *pixbuf)
+{
+        NotifyImage  key;
+        NotifyImage *image;
+        guchar      *pixels;
+        guint32      hash = 2166136261u;
+        gsize        i;
+
+        g_object_get (pixbuf,
+                      "width", &key.width,
+                      "height", &key.height,
+                      "rowstride", &key.rowstride,
+                      "n-channels", &key.n_channels,
+                      "bits-per-sample", &key.bits_per_sample,
+                      "pixels", &pixels,
+                      "has-alpha", &key.has_alpha,
+                      NULL);
+        key.pixels = pixels;
+        key.len = (key.height - 1) * key.rowstride + key.width *
+                ((key.n_channels * key.bits_per_sample + 7) / 8);
+
+        /* FNV-1a over the pixels, then the geometry */
+        for (i = 0; i < key.len; i++)
+                hash = (hash ^ key.pixels[i]) * 16777619u;
+        key.hash = hash ^ (key.width * 31 + key.height) ^ (key.n_channels << 24);
+
+        if (_image_cache == NULL)
+                _image_cache = g_hash_table_new (notify_image_hash,
+                                                 notify_image_equal);
+
+        image = g_hash_table_lookup (_image_cache, &key);
+        if (image != NULL) {
+                g_queue_unlink (&_image_cache_lru, &image->link);
+                g_queue_push_head_link (&_image_cache_lru, &image->link);
+                return g_variant_ref (image->value);
+        }
+
+        image = g_new (NotifyImage, 1);
+        *image = key;
+        image->value = g_variant_new ("(iiibii@ay)",
+                                      key.width,
+                                      key.height,
+                                      key.rowstride,
+                                      key.has_alpha,
+                                      key.bits_per_sample,
+                                      key.n_channels,
+                                      g_variant_new_from_data (G_VARIANT_TYPE ("ay"),
+                                                               pixels,
+                                                               key.len,
+                                                               TRUE,
+                                                               (GDestroyNotify) g_object_unref,
+                                                               g_object_ref (pixbuf)));
+        g_variant_ref_sink (image->value);
+        image->link.prev = image->link.next = NULL;
+        image->link.data = image;
+
+        g_hash_table_insert (_image_cache, image, image);
+        g_queue_push_head_link (&_image_cache_lru, &image->link);
+        _image_cache_size += image->len;
+        notify_image_cache_evict (image);
+
+        return g_variant_ref (image->value);
+}
+
+/*
+ * Images above notify_get_image_spill_threshold() are written once to
+ * $XDG_RUNTIME_DIR/libnotify/images/CHECKSUM.png and sent by path. Every
+ * process using the file holds a hard link to it, CHECKSUM-PID.png, and
+ * sends that path, so the link count of the shared file tells whether
+ * any process still needs it. The last one to let go removes it. Links
+ * left behind by processes that died are swept the first time a process
+ * spills an image.
+ */
+typedef struct
+{
+        char  *shared_path;
+        guint  use_count;
+} NotifyImageFile;
+
+static GHashTable *_image_files = NULL;
+static gboolean    _image_files_swept = FALSE;
+
+/*
+ * Paths of the spilled images the server was sent, by notification ID.
+ * Servers may load them lazily or keep them in their history, so they
+ * are kept until the notification is closed or libnotify uninitialized,
+ * however long the #NotifyNotification lives. If the process exits
+ * first, the next one sweeps them.
+ */
+static GHashTable *_shown_image_files = NULL;
+
+static G_DEFINE_QUARK (notify-image-checksum, notify_image_checksum)
+
+static void
+notify_image_file_unlink_shared (const char *shared_path)
+{
+        struct stat st;
+
+        if (g_stat (shared_path, &st) == 0 && st.st_nlink == 1)
+                g_unlink (shared_path);
+}
+
+static void
+notify_image_files_sweep (const char *dir)
+{
+        GDir       *gdir;
+        const char *name;
+        char        checksum[65];
+        int         pid;
+        char       *path;
+
+        gdir = g_dir_open (dir, 0, NULL);
+        if (gdir == NULL)
+                return;
+
+        while ((name = g_dir_read_name (gdir)) != NULL) {
+                if (sscanf (name, "%64[0-9a-f]-%d.png", checksum, &pid) != 2 ||
+                    pid == getpid () ||
+                    kill (pid, 0) == 0 || errno != ESRCH)
+                        continue;
+
+                path = g_build_filename (dir, name, NULL);
+                g_unlink (path);
+                g_free (path);
+
+                path = g_strdup_printf ("%s/%s.png", dir, checksum);
+                notify_image_file_unlink_shared (path);
+                g_free (path);
+        }
+
+        g_dir_close (gdir);
+}
+
+static gboolean
+notify_image_file_write (GdkPixbuf  *pixbuf,
+                         const char *shared_path)
+{
+        char    *tmp_path;
+        int      fd;
+        gboolean ret;
+
+        tmp_path = g_strdup_printf ("%s.XXXXXX", shared_path);
+        fd = g_mkstemp (tmp_path);
+        if (fd < 0) {
+                g_free (tmp_path);
+                return FALSE;
+        }
+        close (fd);
+
+        /* Written aside and renamed, so other processes never see half of it */
+        ret = gdk_pixbuf_save (pixbuf, tmp_path, "png", NULL, NULL) &&
+              g_rename (tmp_path, shared_path) == 0;
+        if (!ret)
+                g_unlink (tmp_path);
+
+        g_free (tmp_path);
+
+        return ret;
+}
+
+static const char *
+notify_image_get_checksum (GdkPixbuf *pixbuf)
+{
+        GChecksum *checksum;
+        char      *geometry;
+        char      *digest;
+
+        digest = g_object_get_qdata (G_OBJECT (pixbuf), notify_image_checksum_quark ());
+        if (digest != NULL)
+                return digest;
+
+        geometry = g_strdup_printf ("%dx%d/%d/%d",
+                                    gdk_pixbuf_get_width (pixbuf),
+                                    gdk_pixbuf_get_height (pixbuf),
+                                    gdk_pixbuf_get_n_channels (pixbuf),
+                                    gdk_pixbuf_get_has_alpha (pixbuf));
+
+        checksum = g_checksum_new (G_CHECKSUM_SHA256);
+        g_checksum_update (checksum, (const guchar *) geometry, -1);
+        g_checksum_update (checksum,
+                           gdk_pixbuf_read_pixels (pixbuf),
+                           gdk_pixbuf_get_byte_length (pixbuf));
+        digest = g_strdup (g_checksum_get_string (checksum));
+        g_checksum_free (checksum);
+        g_free (geometry);
+
+        g_object_set_qdata_full (G_OBJECT (pixbuf),
+                                 notify_image_checksum_quark (),
+                                 digest,
+                                 g_free);
+
+        return digest;
+}
+
+/*
+ * Returns the path of the link of this process to the file holding
+ * @pixbuf, creating them as needed, or %NULL if the image could not be
+ * spilled. Release it with notify_image_file_release().
+ */
+static char *
+notify_image_file_acquire (GdkPixbuf *pixbuf)
+{
+        NotifyImageFile *file;
+        const char      *checksum;
+        char            *dir;
+        char            *shared_path;
+        char            *path;
+        int              attempt;
+
+        checksum = notify_image_get_checksum (pixbuf);
+        dir = g_build_filename (g_get_user_runtime_dir (), "libnotify", "images", NULL);
+        path = g_strdup_printf ("%s/%s-%d.png", dir, checksum, (int) getpid ());
+
+        if (_image_files == NULL)
+                _image_files = g_hash_table_new (g_str_hash, g_str_equal);
+
+        file = g_hash_table_lookup (_image_files, path);
+        if (file != NULL) {
+                file->use_count++;
+                g_free (dir);
+                return path;
+        }
+
+        if (g_mkdir_with_parents (dir, 0700) != 0) {
+                g_free (dir);
+                g_free (path);
+                return NULL;
+        }
+
+        if (!_image_files_swept) {
+                notify_image_files_sweep (dir);
+                _image_files_swept = TRUE;
+        }
+
+        shared_path = g_strdup_printf ("%s/%s.png", dir, checksum);
+        g_free (dir);
+
+        /* Another process may remove the shared file before we link to it */
+        for (attempt = 0; attempt < 2; attempt++) {
+                if (link (shared_path, path) == 0 || errno == EEXIST)
+                        break;
+
+                if (errno != ENOENT ||
+                    !notify_image_file_write (pixbuf, shared_path)) {
+                        attempt = 2;
+                        break;
+                }
+        }
+
+        if (attempt == 2) {
+                g_free (shared_path);
+                g_free (path);
+                return NULL;
+        }
+
+        file = g_new (NotifyImageFile, 1);
+        file->shared_path = shared_path;
+        file->use_count = 1;
+        g_hash_table_insert (_image_files, g_strdup (path), file);
+
+        return path;
+}
+
+/* Releases the path returned by notify_image_file_acquire(), and frees it */
+static void
+notify_image_file_release (char *path)
+{
+        NotifyImageFile *file;
+        char            *key;
+
+        if (_image_files != NULL &&
+            g_hash_table_lookup_extended (_image_files, path,
+                                          (gpointer *) &key,
+                                          (gpointer *) &file) &&
+            --file->use_count == 0) {
+                g_hash_table_remove (_image_files, path);
+
+                g_unlink (path);
+                notify_image_file_unlink_shared (file->shared_path);
+
+                g_free (file->shared_path);
+                g_free (file);
+                g_free (key);
+        }
+
+        g_free (path);
+}
+
+/* Takes another reference to the path returned by notify_image_file_acquire() */
+static char *
+notify_image_file_ref (const char *path)
+{
+        NotifyImageFile *file;
+
+        file = g_hash_table_lookup (_image_files, path);
+        g_assert (file != NULL);
+        file->use_count++;
+
+        return g_strdup (path);
+}
+
+/* Keeps the image file at @path until the notification @id is closed */
+static void
+notify_image_file_shown (guint32     id,
+                         const char *path)
+{
+        if (_shown_image_files == NULL)
+                _shown_image_files = g_hash_table_new_full (g_direct_hash,
+                                                            g_direct_equal,
+                                                            NULL,
+                                                            (GDestroyNotify) notify_image_file_release);
+
+        /* Any previous image of @id is released after this one is taken */
+        g_hash_table_replace (_shown_image_files,
+                              GUINT_TO_POINTER (id),
+                              notify_image_file_ref (path));
+
+        _notify_update_signal_subscriptions ();
+}
+
+/*
+ * _notify_image_files_shown:
+ *
+ * Returns: %TRUE if spilled image files wait for their notification to
+ *   be closed
+ */
+gboolean
+_notify_image_files_shown (void)
+{
+        return _shown_image_files != NULL &&
+               g_hash_table_size (_shown_image_files) > 0;
+}
+
+/*
+ * _notify_image_files_closed:
+ * @id: the ID of a notification the server closed
+ *
+ * Releases the image file notification @id was shown with, if any.
+ */
+void
+_notify_image_files_closed (guint32 id)
+{
+        if (_shown_image_files == NULL ||
+            !g_hash_table_remove (_shown_image_files, GUINT_TO_POINTER (id)))
+                return;
+
+        _notify_update_signal_subscriptions ();
+}
+
+/*
+ * _notify_image_files_forget:
+ *
+ * Releases the image files of all the notifications shown, when
+ * libnotify is uninitialized.
+ */
+void
+_notify_image_files_forget (void)
+{
+        if (_shown_image_files != NULL) {
+                g_hash_table_destroy (_shown_image_files);
+                _shown_image_files = NULL;
+        }
+}
+
+#ifdef HAVE_MEMFD
+static G_DEFINE_QUARK (notify-image-fd, notify_image_fd)
+
+static void
+notify_image_fd_close (gpointer data)
+{
+        close (GPOINTER_TO_INT (data) - 1);
+}
+
+/*
+ * Returns a sealed memfd holding the pixels of @pixbuf, or -1. The file
+ * descriptor is kept open on @pixbuf, so that every notification using
+ * the image passes the same memory.
+ */
+static int
+notify_image_get_fd (GdkPixbuf *pixbuf)
+{
+        gpointer      data;
+        const guint8 *pixels;
+        gsize         len;
+        gssize        written;
+        int           fd;
+
+        data = g_object_get_qdata (G_OBJECT (pixbuf), notify_image_fd_quark ());
+        if (data != NULL)
+                return GPOINTER_TO_INT (data) - 1;
+
+        fd = memfd_create ("libnotify-image", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0)
+                return -1;
+
+        pixels = gdk_pixbuf_read_pixels (pixbuf);
+        len = gdk_pixbuf_get_byte_length (pixbuf);
+        while (len > 0) {
+                written = write (fd, pixels, len);
+                if (written < 0 && errno == EINTR)
+                        continue;
+                if (written < 0) {
+                        close (fd);
+                        return -1;
+                }
+
+                pixels += written;
+                len -= written;
+        }
+
+        /* The server maps the pixels, so they must not change under it */
+        if (fcntl (fd, F_ADD_SEALS,
+                   F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+                close (fd);
+                return -1;
+        }
+
+        g_object_set_qdata_full (G_OBJECT (pixbuf),
+                                 notify_image_fd_quark (),
+                                 GINT_TO_POINTER (fd + 1),
+                                 notify_image_fd_close);
+
+        return fd;
+}
+#endif
+
+/*
+ * Sets the hint carrying the image set with
+ * notify_notification_set_image_from_pixbuf(). Which hint it is depends
+ * on the server, so this is only done when @notification is sent, from
+ * what is known of the server by then.
+ */
+static void
+notify_notification_apply_image (NotifyNotification *notification)
+{
+        NotifyNotificationPrivate *priv = notification->priv;
+        GdkPixbuf      *pixbuf = priv->image_pixbuf;
+        GVariant       *value;
+        const char     *hint_name;
+        const char     *path_hint_name = NULL;
+        char           *image_file = NULL;
+        char           *uri = NULL;
+        gsize           threshold;
+
+        priv->updates_pending &= ~NOTIFY_UPDATE_IMAGE;
+
+        if (_notify_check_spec_version(1, 2)) {
+                hint_name = "image-data";
+                path_hint_name = "image-path";
+        } else if (_notify_check_spec_version(1, 1)) {
+                hint_name = "image_data";
+                path_hint_name = "image_path";
+        } else {
+                hint_name = "icon_data";
+        }
+
+        if (priv->image_hint != NULL) {
+                notify_notification_set_hint (notification, priv->image_hint, NULL);
+                priv->image_hint = NULL;
+        }
+
+        if (priv->image_file != NULL) {
+                notify_image_file_release (priv->image_file);
+                priv->image_file = NULL;
+        }
+
+        if (priv->image_fd_pixbuf != NULL) {
+                g_object_unref (priv->image_fd_pixbuf);
+                priv->image_fd_pixbuf = NULL;
+        }
 
-/**
- * notify_notification_set_icon_from_pixbuf:
- * @notification: The notification.
- * @icon: The icon.
- *
- * Sets the icon in the notification from a #GdkPixbuf.
- * Deprecated: use notify_notification_set_image_from_pixbuf() instead.
- *
- */
-void
-notify_notification_set_icon_from_pixbuf (NotifyNotification *notification,
-                                          GdkPixbuf          *icon)
-{
-        notify_notification_set_image_from_pixbuf (notification, icon);
+        if (pixbuf == NULL)
+                return;
+
+#ifdef HAVE_MEMFD
+        if (_notify_server_has_image_fd () &&
+            notify_image_get_fd (pixbuf) >= 0) {
+                /* The pixels follow the message, as handle 0 */
+                notify_notification_set_hint (notification,
+                                              NOTIFY_IMAGE_FD_HINT,
+                                              g_variant_new ("(iiibiih)",
+                                                             gdk_pixbuf_get_width (pixbuf),
+                                                             gdk_pixbuf_get_height (pixbuf),
+                                                             gdk_pixbuf_get_rowstride (pixbuf),
+                                                             gdk_pixbuf_get_has_alpha (pixbuf),
+                                                             gdk_pixbuf_get_bits_per_sample (pixbuf),
+                                                             gdk_pixbuf_get_n_channels (pixbuf),
+                                                             0));
+                priv->image_hint = NOTIFY_IMAGE_FD_HINT;
+                priv->image_fd_pixbuf = g_object_ref (pixbuf);
+                return;
+        }
+#endif
+
+        /* Spilling needs the image path hint of spec 1.1 */
+        threshold = notify_get_image_spill_threshold ();
+        if (path_hint_name != NULL && threshold > 0 &&
+            gdk_pixbuf_get_byte_length (pixbuf) > threshold)
+                image_file = notify_image_file_acquire (pixbuf);
+
+        if (image_file != NULL) {
+                uri = g_filename_to_uri (image_file, NULL, NULL);
+                if (uri == NULL)
+                        notify_image_file_release (image_file);
+        }
+
+        if (uri != NULL) {
+                priv->image_file = image_file;
+                priv->image_hint = path_hint_name;
+                notify_notification_set_hint_string (notification, path_hint_name, uri);
+                g_free (uri);
+        } else {
+                priv->image_hint = hint_name;
+                value = notify_image_cache_lookup (pixbuf);
+                notify_notification_set_hint (notification, hint_name, value);
+                g_variant_unref (value);
+        }
 }
 
 /**
@@ -796,63 +2662,29 @@ notify_notification_set_icon_from_pixbuf (NotifyNotification *notification,
  *
  * Sets the image in the notification from a #GdkPixbuf.
  *
+ * Images larger than notify_get_max_image_size() are downscaled first,
+ * keeping their aspect ratio. The scaled copy is cached on @pixbuf, and
+ * the serialized image is shared with the other notifications using the
+ * same pixels, so @pixbuf must not be modified afterwards. Images still
+ * larger than notify_get_image_spill_threshold() are sent as a file.
+ *
+ * If the server supports it, the pixels are passed in shared memory
+ * rather than copied into the message.
+ *
  */
 void
 notify_notification_set_image_from_pixbuf (NotifyNotification *notification,
                                            GdkPixbuf          *pixbuf)
 {
-        gint            width;
-        gint            height;
-        gint            rowstride;
-        gint            bits_per_sample;
-        gint            n_channels;
-        guchar         *image;
-        gboolean        has_alpha;
-        gsize           image_len;
-        GVariant       *value;
-        const char     *hint_name;
+        NotifyNotificationPrivate *priv = notification->priv;
 
         g_return_if_fail (pixbuf == NULL || GDK_IS_PIXBUF (pixbuf));
 
-        if (_notify_check_spec_version(1, 2)) {
-                hint_name = "image-data";
-        } else if (_notify_check_spec_version(1, 1)) {
-                hint_name = "image_data";
-        } else {
-                hint_name = "icon_data";
-        }
-
-        if (pixbuf == NULL) {
-                notify_notification_set_hint (notification, hint_name, NULL);
-                return;
-        }
+        if (priv->image_pixbuf != NULL)
+                g_object_unref (priv->image_pixbuf);
 
-        g_object_get (pixbuf,
-                      "width", &width,
-                      "height", &height,
-                      "rowstride", &rowstride,
-                      "n-channels", &n_channels,
-                      "bits-per-sample", &bits_per_sample,
-                      "pixels", &image,
-                      "has-alpha", &has_alpha,
-                      NULL);
-        image_len = (height - 1) * rowstride + width *
-                ((n_channels * bits_per_sample + 7) / 8);
-
-        value = g_variant_new ("(iiibii@ay)",
-                               width,
-                               height,
-                               rowstride,
-                               has_alpha,
-                               bits_per_sample,
-                               n_channels,
-                               g_variant_new_from_data (G_VARIANT_TYPE ("ay"),
-                                                        image,
-                                                        image_len,
-                                                        TRUE,
-                                                        (GDestroyNotify) g_object_unref,
-                                                        g_object_ref (pixbuf)));
-        notify_notification_set_hint (notification, hint_name, value);
+        priv->image_pixbuf = pixbuf != NULL ? notify_notification_scale_image (pixbuf) : NULL;
+        priv->updates_pending |= NOTIFY_UPDATE_IMAGE;
 }
 
 static GVariant *
@@ -907,11 +2739,13 @@ notify_notification_set_hint (NotifyNotification *notification,
 
         if (value != NULL) {
                 value = maybe_parse_snap_hint_value (key, value);
-                g_hash_table_insert (notification->priv->hints,
-                                    g_strdup (key),
-                                    g_variant_ref_sink (value));
+                notify_hints_insert (&notification->priv->hints,
+                                     key,
+                                     notify_share_hint_value (g_variant_ref_sink (value)));
+                notification->priv->updates_pending |= NOTIFY_UPDATE_HINTS;
         } else {
-                g_hash_table_remove (notification->priv->hints, key);
+                if (notify_hints_remove (&notification->priv->hints, key))
+                        notification->priv->updates_pending |= NOTIFY_UPDATE_HINTS;
         }
 }
 
@@ -933,8 +2767,7 @@ notify_notification_set_app_name (NotifyNotification *notification,
 {
         g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
 
-        g_free (notification->priv->app_name);
-        notification->priv->app_name = g_strdup (app_name);
+        notification->priv->app_name = g_intern_string (app_name);
 
         g_object_notify (G_OBJECT (notification), "app-name");
 }
@@ -1070,12 +2903,6 @@ notify_notification_set_hint_string (NotifyNotification *notification,
         }
 }
 
-static gboolean
-_remove_all (void)
-{
-        return TRUE;
-}
-
 /**
  * notify_notification_clear_hints:
  * @notification: The notification.
@@ -1085,12 +2912,23 @@ _remove_all (void)
 void
 notify_notification_clear_hints (NotifyNotification *notification)
 {
+        NotifyNotificationPrivate *priv;
+
         g_return_if_fail (notification != NULL);
         g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
 
-        g_hash_table_foreach_remove (notification->priv->hints,
-                                     (GHRFunc) _remove_all,
-                                     NULL);
+        priv = notification->priv;
+
+        /* The image goes with the hints it is sent in */
+        if (priv->image_pixbuf != NULL) {
+                g_object_unref (priv->image_pixbuf);
+                priv->image_pixbuf = NULL;
+        }
+        priv->image_hint = NULL;
+        priv->updates_pending &= ~NOTIFY_UPDATE_IMAGE;
+
+        notify_hints_clear (&priv->hints);
+        priv->updates_pending |= NOTIFY_UPDATE_HINTS;
 }
 
 /**
@@ -1105,19 +2943,11 @@ notify_notification_clear_actions (NotifyNotification *notification)
         g_return_if_fail (notification != NULL);
         g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
 
-        g_hash_table_foreach_remove (notification->priv->action_map,
-                                     (GHRFunc) _remove_all,
-                                     NULL);
+        if (notification->priv->actions != NULL)
+                g_array_set_size (notification->priv->actions, 0);
 
-        if (notification->priv->actions != NULL) {
-                g_slist_foreach (notification->priv->actions,
-                                 (GFunc) g_free,
-                                 NULL);
-                g_slist_free (notification->priv->actions);
-        }
-
-        notification->priv->actions = NULL;
         notification->priv->has_nondefault_actions = FALSE;
+        notification->priv->updates_pending |= NOTIFY_UPDATE_ACTIONS;
 }
 
 /**
@@ -1143,7 +2973,7 @@ notify_notification_add_action (NotifyNotification  *notification,
                                 GFreeFunc            free_func)
 {
         NotifyNotificationPrivate *priv;
-        CallbackPair              *pair;
+        NotifyAction              *entry;
 
         g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
         g_return_if_fail (action != NULL && *action != '\0');
@@ -1152,14 +2982,15 @@ notify_notification_add_action (NotifyNotification  *notification,
 
         priv = notification->priv;
 
-        priv->actions = g_slist_append (priv->actions, g_strdup (action));
-        priv->actions = g_slist_append (priv->actions, g_strdup (label));
+        if (priv->actions == NULL)
+                priv->actions = notify_actions_new ();
 
-        pair = g_new0 (CallbackPair, 1);
-        pair->cb = callback;
-        pair->user_data = user_data;
-        pair->free_func = free_func;
-        g_hash_table_insert (priv->action_map, g_strdup (action), pair);
+        entry = notify_actions_add (priv->actions, action);
+        entry->label = g_strdup (label);
+        entry->cb = callback;
+        entry->user_data = user_data;
+        entry->free_func = free_func;
+        priv->updates_pending |= NOTIFY_UPDATE_ACTIONS;
 
         if (!notification->priv->has_nondefault_actions &&
             g_ascii_strcasecmp (action, "default") != 0) {
@@ -1167,6 +2998,12 @@ notify_notification_add_action (NotifyNotification  *notification,
         }
 }
 
+GList *
+_notify_notification_get_cache_link (NotifyNotification *n)
+{
+        return &n->priv->cache_link;
+}
+
 gboolean
 _notify_notification_has_nondefault_actions (const NotifyNotification *n)
 {
@@ -1190,7 +3027,6 @@ notify_notification_close (NotifyNotification *notification,
                            GError            **error)
 {
         NotifyNotificationPrivate *priv;
-        GDBusProxy  *proxy;
         GVariant   *result;
 
         g_return_val_if_fail (NOTIFY_IS_NOTIFICATION (notification), FALSE);
@@ -1198,19 +3034,16 @@ notify_notification_close (NotifyNotification *notification,
 
         priv = notification->priv;
 
-        proxy = _notify_get_proxy (error);
-        if (proxy == NULL) {
-                return FALSE;
-        }
+        /* The last update is not lost, even if the main loop never runs again */
+        _notify_notification_flush_sync (notification);
+        _notify_rate_limit_forget (notification);
 
-        /* FIXME: make this nonblocking! */
-        result = g_dbus_proxy_call_sync (proxy,
-                                         "CloseNotification",
-                                         g_variant_new ("(u)", priv->id),
-                                         G_DBUS_CALL_FLAGS_NONE,
-                                         -1 /* FIXME! */,
-                                         NULL,
-                                         error);
+        result = _notify_call_sync ("CloseNotification",
+                                    g_variant_new ("(u)", priv->id),
+                                    G_VARIANT_TYPE_UNIT,
+                                    priv->call_timeout,
+                                    NULL,
+                                    error);
         if (result == NULL) {
                 return FALSE;
         }
@@ -1220,6 +3053,94 @@ notify_notification_close (NotifyNotification *notification,
         return TRUE;
 }
 
+static void
+notify_notification_close_cb (GObject      *source,
+                              GAsyncResult *res,
+                              gpointer      user_data)
+{
+        GTask    *task = G_TASK (user_data);
+        GVariant *result;
+        GError   *error = NULL;
+
+        result = _notify_call_finish (res, &error);
+        if (result == NULL) {
+                g_task_return_error (task, error);
+        } else {
+                g_variant_unref (result);
+                g_task_return_boolean (task, TRUE);
+        }
+
+        g_object_unref (task);
+}
+
+/**
+ * notify_notification_close_async:
+ * @notification: The notification.
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the
+ *            request has been handled
+ * @user_data: (closure): the data to pass to @callback
+ *
+ * Asynchronously tells the notification server to hide the notification
+ * on the screen. This is the non-blocking version of
+ * notify_notification_close().
+ *
+ * When the operation is finished, @callback will be called. You can then
+ * call notify_notification_close_finish() to get the result of the
+ * operation.
+ *
+ * Since: 0.8
+ */
+void
+notify_notification_close_async (NotifyNotification *notification,
+                                 GCancellable       *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer            user_data)
+{
+        GTask      *task;
+
+        g_return_if_fail (NOTIFY_IS_NOTIFICATION (notification));
+        g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+        task = g_task_new (notification, cancellable, callback, user_data);
+        g_task_set_source_tag (task, notify_notification_close_async);
+
+        notify_notification_cancel_flush (notification);
+        _notify_rate_limit_forget (notification);
+
+        _notify_call ("CloseNotification",
+                      g_variant_new ("(u)", notification->priv->id),
+                      G_VARIANT_TYPE_UNIT,
+                      notification->priv->call_timeout,
+                      cancellable,
+                      notify_notification_close_cb,
+                      task);
+}
+
+/**
+ * notify_notification_close_finish:
+ * @notification: The notification.
+ * @result: the #GAsyncResult passed to the callback
+ * @error: The returned error information.
+ *
+ * Finishes an operation started with notify_notification_close_async().
+ *
+ * Returns: %TRUE on success, or %FALSE on error with @error filled in
+ *
+ * Since: 0.8
+ */
+gboolean
+notify_notification_close_finish (NotifyNotification *notification,
+                                  GAsyncResult       *result,
+                                  GError            **error)
+{
+        g_return_val_if_fail (NOTIFY_IS_NOTIFICATION (notification), FALSE);
+        g_return_val_if_fail (g_task_is_valid (result, notification), FALSE);
+        g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+        return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 /**
  * notify_notification_get_closed_reason:
  * @notification: The notification.
@@ -1237,3 +3158,367 @@ notify_notification_get_closed_reason (const NotifyNotification *notification)
 
         return notification->priv->closed_reason;
 }
+
+/**
+ * NotifyTemplate:
+ *
+ * A template for notifications of the same kind. It holds everything
+ * but their summary and body: application name, icon, timeout, hints
+ * and actions. These are serialized once for all the notifications
+ * created from the template with notify_notification_new_from_template().
+ *
+ * Since: 0.8
+ */
+struct _NotifyTemplate
+{
+        gint            ref_count;
+        const char     *app_name;      /* interned */
+        char           *icon_name;
+        gint            timeout;
+        NotifyHints     hints;
+        GArray         *actions;
+        gboolean        has_nondefault_actions;
+
+        /* Serialized hints and actions, NULL if they changed since */
+        GVariant       *hints_variant;
+        GVariant       *actions_variant;
+};
+
+G_DEFINE_BOXED_TYPE (NotifyTemplate, notify_template,
+                     notify_template_ref, notify_template_unref)
+
+/**
+ * notify_template_new:
+ * @app_name: (allow-none): The application name, or %NULL to use the one
+ *   set with notify_set_app_name().
+ * @icon: (allow-none): The optional icon theme icon name or filename.
+ *
+ * Creates a new #NotifyTemplate.
+ *
+ * Returns: (transfer full): The new #NotifyTemplate.
+ *
+ * Since: 0.8
+ */
+NotifyTemplate *
+notify_template_new (const char *app_name,
+                     const char *icon)
+{
+        NotifyTemplate *tmpl;
+
+        tmpl = g_new0 (NotifyTemplate, 1);
+        tmpl->ref_count = 1;
+        tmpl->app_name = g_intern_string (app_name);
+        tmpl->timeout = NOTIFY_EXPIRES_DEFAULT;
+
+        if (icon != NULL && *icon != '\0') {
+                tmpl->icon_name = try_prepend_desktop (icon);
+                if (tmpl->icon_name == NULL)
+                        tmpl->icon_name = g_strdup (icon);
+        }
+
+        return tmpl;
+}
+
+/**
+ * notify_template_ref:
+ * @tmpl: a #NotifyTemplate
+ *
+ * Increases the reference count of @tmpl.
+ *
+ * Returns: (transfer full): @tmpl
+ *
+ * Since: 0.8
+ */
+NotifyTemplate *
+notify_template_ref (NotifyTemplate *tmpl)
+{
+        g_return_val_if_fail (tmpl != NULL, NULL);
+
+        g_atomic_int_inc (&tmpl->ref_count);
+
+        return tmpl;
+}
+
+/**
+ * notify_template_unref:
+ * @tmpl: a #NotifyTemplate
+ *
+ * Decreases the reference count of @tmpl, freeing it when it drops
+ * to zero. The notifications created from @tmpl hold a reference to
+ * it until they are finalized or reset, so it may be unreffed as soon as
+ * they are created.
+ *
+ * Since: 0.8
+ */
+void
+notify_template_unref (NotifyTemplate *tmpl)
+{
+        g_return_if_fail (tmpl != NULL);
+
+        if (!g_atomic_int_dec_and_test (&tmpl->ref_count))
+                return;
+
+        notify_hints_clear (&tmpl->hints);
+        g_free (tmpl->hints.items);
+
+        if (tmpl->actions != NULL)
+                g_array_unref (tmpl->actions);
+
+        if (tmpl->hints_variant != NULL)
+                g_variant_unref (tmpl->hints_variant);
+
+        if (tmpl->actions_variant != NULL)
+                g_variant_unref (tmpl->actions_variant);
+
+        g_free (tmpl->icon_name);
+        g_free (tmpl);
+}
+
+static void
+notify_template_set_hints_changed (NotifyTemplate *tmpl)
+{
+        if (tmpl->hints_variant != NULL) {
+                g_variant_unref (tmpl->hints_variant);
+                tmpl->hints_variant = NULL;
+        }
+}
+
+/**
+ * notify_template_set_timeout:
+ * @tmpl: a #NotifyTemplate
+ * @timeout: The timeout in milliseconds.
+ *
+ * Sets the timeout of the notifications created from @tmpl, see
+ * notify_notification_set_timeout().
+ *
+ * Since: 0.8
+ */
+void
+notify_template_set_timeout (NotifyTemplate *tmpl,
+                             gint            timeout)
+{
+        g_return_if_fail (tmpl != NULL);
+
+        tmpl->timeout = timeout;
+}
+
+/**
+ * notify_template_set_category:
+ * @tmpl: a #NotifyTemplate
+ * @category: The category.
+ *
+ * Sets the category of the notifications created from @tmpl, see
+ * notify_notification_set_category().
+ *
+ * Since: 0.8
+ */
+void
+notify_template_set_category (NotifyTemplate *tmpl,
+                              const char     *category)
+{
+        g_return_if_fail (tmpl != NULL);
+
+        if (category != NULL && category[0] != '\0') {
+                notify_hints_insert (&tmpl->hints,
+                                     "category",
+                                     g_variant_ref (notify_shared_category (category)));
+                notify_template_set_hints_changed (tmpl);
+        }
+}
+
+/**
+ * notify_template_set_urgency:
+ * @tmpl: a #NotifyTemplate
+ * @urgency: The urgency level.
+ *
+ * Sets the urgency level of the notifications created from @tmpl,
+ * see notify_notification_set_urgency().
+ *
+ * Since: 0.8
+ */
+void
+notify_template_set_urgency (NotifyTemplate *tmpl,
+                             NotifyUrgency   urgency)
+{
+        GVariant *value;
+
+        g_return_if_fail (tmpl != NULL);
+
+        if (urgency > NOTIFY_URGENCY_CRITICAL)
+                value = g_variant_ref_sink (g_variant_new_byte ((guchar) urgency));
+        else
+                value = g_variant_ref (notify_shared_urgency (urgency));
+
+        notify_hints_insert (&tmpl->hints, "urgency", value);
+        notify_template_set_hints_changed (tmpl);
+}
+
+/**
+ * notify_template_set_hint:
+ * @tmpl: a #NotifyTemplate
+ * @key: the hint key
+ * @value: (allow-none): the hint value, or %NULL to unset the hint
+ *
+ * Sets a hint of the notifications created from @tmpl, see
+ * notify_notification_set_hint().
+ *
+ * If @value is floating, it is consumed.
+ *
+ * Since: 0.8
+ */
+void
+notify_template_set_hint (NotifyTemplate *tmpl,
+                          const char     *key,
+                          GVariant       *value)
+{
+        g_return_if_fail (tmpl != NULL);
+        g_return_if_fail (key != NULL && *key != '\0');
+
+        if (value != NULL) {
+                value = maybe_parse_snap_hint_value (key, value);
+                notify_hints_insert (&tmpl->hints,
+                                     key,
+                                     notify_share_hint_value (g_variant_ref_sink (value)));
+                notify_template_set_hints_changed (tmpl);
+        } else if (notify_hints_remove (&tmpl->hints, key)) {
+                notify_template_set_hints_changed (tmpl);
+        }
+}
+
+/**
+ * notify_template_add_action:
+ * @tmpl: a #NotifyTemplate
+ * @action: The action ID.
+ * @label: The human-readable action label.
+ * @callback: The action's callback function.
+ * @user_data: Optional custom data to pass to @callback.
+ * @free_func: (type GLib.DestroyNotify): An optional function to free @user_data when the template
+ *             is freed.
+ *
+ * Adds an action to the notifications created from @tmpl, see
+ * notify_notification_add_action(). @user_data belongs to @tmpl and
+ * is passed to @callback for all of them. @free_func is called once
+ * @tmpl and every notification created from it are gone.
+ *
+ * Since: 0.8
+ */
+void
+notify_template_add_action (NotifyTemplate      *tmpl,
+                            const char          *action,
+                            const char          *label,
+                            NotifyActionCallback callback,
+                            gpointer             user_data,
+                            GFreeFunc            free_func)
+{
+        NotifyAction *entry;
+
+        g_return_if_fail (tmpl != NULL);
+        g_return_if_fail (action != NULL && *action != '\0');
+        g_return_if_fail (label != NULL && *label != '\0');
+        g_return_if_fail (callback != NULL);
+
+        if (tmpl->actions == NULL)
+                tmpl->actions = notify_actions_new ();
+
+        entry = notify_actions_add (tmpl->actions, action);
+        entry->label = g_strdup (label);
+        entry->cb = callback;
+        entry->user_data = user_data;
+        entry->free_func = free_func;
+
+        if (g_ascii_strcasecmp (action, "default") != 0)
+                tmpl->has_nondefault_actions = TRUE;
+
+        if (tmpl->actions_variant != NULL) {
+                g_variant_unref (tmpl->actions_variant);
+                tmpl->actions_variant = NULL;
+        }
+}
+
+/**
+ * notify_notification_new_from_template:
+ * @tmpl: a #NotifyTemplate
+ * @summary: The required summary text.
+ * @body: (allow-none): The optional body text.
+ *
+ * Creates a new #NotifyNotification with the application name, icon,
+ * timeout, hints and actions of @tmpl. The hints and actions are
+ * shared with @tmpl, already serialized, until they are changed on
+ * the notification, so creating and showing it costs little more than
+ * copying @summary and @body.
+ *
+ * The notification holds a reference to @tmpl, whose action user data
+ * it passes to the callbacks, until it is finalized or reset.
+ *
+ * Returns: The new #NotifyNotification.
+ *
+ * Since: 0.8
+ */
+NotifyNotification *
+notify_notification_new_from_template (NotifyTemplate *tmpl,
+                                       const char     *summary,
+                                       const char     *body)
+{
+        NotifyNotification        *notification;
+        NotifyNotificationPrivate *priv;
+        NotifyAction              *from;
+        NotifyAction              *to;
+        guint                      i;
+
+        g_return_val_if_fail (tmpl != NULL, NULL);
+        g_return_val_if_fail (summary != NULL, NULL);
+
+        if (tmpl->hints_variant == NULL)
+                tmpl->hints_variant = notify_hints_serialize (&tmpl->hints);
+        if (tmpl->actions_variant == NULL)
+                tmpl->actions_variant = notify_actions_serialize (tmpl->actions);
+
+        notification = _notify_pool_take ();
+        if (notification == NULL)
+                notification = g_object_new (NOTIFY_TYPE_NOTIFICATION, NULL);
+        priv = notification->priv;
+
+        /* A new or reset notification, so no one can be told about these */
+        priv->app_name = tmpl->app_name;
+        priv->summary = g_strdup (summary);
+        priv->body = body != NULL && *body != '\0' ? g_strdup (body) : NULL;
+        priv->icon_name = g_strdup (tmpl->icon_name);
+        priv->timeout = tmpl->timeout;
+
+        notify_hints_reserve (&priv->hints, tmpl->hints.len);
+        for (i = 0; i < tmpl->hints.len; i++) {
+                priv->hints.items[i].key = tmpl->hints.items[i].key;
+                priv->hints.items[i].value = g_variant_ref (tmpl->hints.items[i].value);
+        }
+        priv->hints.len = tmpl->hints.len;
+
+        if (tmpl->actions != NULL && tmpl->actions->len > 0) {
+                if (priv->actions == NULL)
+                        priv->actions = notify_actions_new ();
+
+                g_array_set_size (priv->actions, tmpl->actions->len);
+                for (i = 0; i < tmpl->actions->len; i++) {
+                        from = &g_array_index (tmpl->actions, NotifyAction, i);
+                        to = &g_array_index (priv->actions, NotifyAction, i);
+                        to->id = g_strdup (from->id);
+                        to->label = g_strdup (from->label);
+                        to->cb = from->cb;
+                        to->user_data = from->user_data;
+                        to->free_func = NULL;
+                }
+        }
+        priv->has_nondefault_actions = tmpl->has_nondefault_actions;
+        priv->tmpl = notify_template_ref (tmpl);
+
+        if (priv->hints_variant != NULL)
+                g_variant_unref (priv->hints_variant);
+        priv->hints_variant = g_variant_ref (tmpl->hints_variant);
+
+        if (priv->actions_variant != NULL)
+                g_variant_unref (priv->actions_variant);
+        priv->actions_variant = g_variant_ref (tmpl->actions_variant);
+
+        priv->updates_pending = 0;
+
+        return notification;
+}
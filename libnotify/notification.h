@@ -25,6 +25,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
 G_BEGIN_DECLS
@@ -44,6 +45,15 @@ G_BEGIN_DECLS
  */
 #define NOTIFY_EXPIRES_NEVER    0
 
+/**
+ * NOTIFY_CALL_TIMEOUT_DEFAULT:
+ *
+ * The default deadline for requests sent to the notification server.
+ *
+ * Since: 0.8
+ */
+#define NOTIFY_CALL_TIMEOUT_DEFAULT -1
+
 #define NOTIFY_TYPE_NOTIFICATION         (notify_notification_get_type ())
 #define NOTIFY_NOTIFICATION(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), NOTIFY_TYPE_NOTIFICATION, NotifyNotification))
 #define NOTIFY_NOTIFICATION_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST((k), NOTIFY_TYPE_NOTIFICATION, NotifyNotificationClass))
@@ -120,12 +130,29 @@ gboolean            notify_notification_update                (NotifyNotificatio
                                                                const char         *body,
                                                                const char         *icon);
 
+void                notify_notification_reset                 (NotifyNotification *notification);
+
 gboolean            notify_notification_show                  (NotifyNotification *notification,
                                                                GError            **error);
 
+void                notify_notification_show_async            (NotifyNotification *notification,
+                                                               GCancellable       *cancellable,
+                                                               GAsyncReadyCallback callback,
+                                                               gpointer            user_data);
+
+gboolean            notify_notification_show_finish           (NotifyNotification *notification,
+                                                               GAsyncResult       *result,
+                                                               GError            **error);
+
 void                notify_notification_set_timeout           (NotifyNotification *notification,
                                                                gint                timeout);
 
+void                notify_notification_set_call_timeout      (NotifyNotification *notification,
+                                                               gint                timeout);
+
+void                notify_notification_set_max_update_rate   (NotifyNotification *notification,
+                                                               guint               rate);
+
 void                notify_notification_set_category          (NotifyNotification *notification,
                                                                const char         *category);
 
@@ -184,7 +211,53 @@ void                notify_notification_clear_actions         (NotifyNotificatio
 gboolean            notify_notification_close                 (NotifyNotification *notification,
                                                                GError            **error);
 
+void                notify_notification_close_async           (NotifyNotification *notification,
+                                                               GCancellable       *cancellable,
+                                                               GAsyncReadyCallback callback,
+                                                               gpointer            user_data);
+
+gboolean            notify_notification_close_finish          (NotifyNotification *notification,
+                                                               GAsyncResult       *result,
+                                                               GError            **error);
+
 gint                notify_notification_get_closed_reason     (const NotifyNotification *notification);
 
+#define NOTIFY_TYPE_TEMPLATE (notify_template_get_type ())
+
+typedef struct _NotifyTemplate NotifyTemplate;
+
+GType               notify_template_get_type                  (void);
+
+NotifyTemplate     *notify_template_new                       (const char         *app_name,
+                                                               const char         *icon);
+
+NotifyTemplate     *notify_template_ref                       (NotifyTemplate     *tmpl);
+
+void                notify_template_unref                     (NotifyTemplate     *tmpl);
+
+void                notify_template_set_timeout               (NotifyTemplate     *tmpl,
+                                                               gint                timeout);
+
+void                notify_template_set_category              (NotifyTemplate     *tmpl,
+                                                               const char         *category);
+
+void                notify_template_set_urgency               (NotifyTemplate     *tmpl,
+                                                               NotifyUrgency       urgency);
+
+void                notify_template_set_hint                  (NotifyTemplate     *tmpl,
+                                                               const char         *key,
+                                                               GVariant           *value);
+
+void                notify_template_add_action                (NotifyTemplate     *tmpl,
+                                                               const char         *action,
+                                                               const char         *label,
+                                                               NotifyActionCallback callback,
+                                                               gpointer            user_data,
+                                                               GFreeFunc           free_func);
+
+NotifyNotification *notify_notification_new_from_template     (NotifyTemplate     *tmpl,
+                                                               const char         *summary,
+                                                               const char         *body);
+
 G_END_DECLS
 #endif /* NOTIFY_NOTIFICATION_H */
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <glib.h>
@@ -35,6 +36,13 @@
 #include "internal.h"
 #include "notify-marshal.h"
 
+/* Large enough for the icons of notification bubbles on HiDPI screens */
+#define NOTIFY_DEFAULT_MAX_IMAGE_SIZE   128
+
+/* Bounds of the deadlines derived from the observed round-trip times */
+#define NOTIFY_ADAPTIVE_TIMEOUT_MIN     500
+#define NOTIFY_ADAPTIVE_TIMEOUT_MAX     25000
+
 /**
  * SECTION:notify
  * @Short_description: Notification API
@@ -43,15 +51,67 @@
 
 static gboolean         _initted = FALSE;
 static char            *_app_name = NULL;
-static GDBusProxy      *_proxy = NULL;
-static GList           *_active_notifications = NULL;
+static GDBusConnection *_connection = NULL;
+static guint            _closed_subscription = 0;
+static guint            _action_subscription = 0;
+static guint            _name_owner_subscription = 0;
+static GQueue           _active_notifications = G_QUEUE_INIT;
+static GQueue           _connection_waiters = G_QUEUE_INIT;
+static GHashTable      *_notifications_by_id = NULL;
+static GHashTable      *_signal_listeners = NULL;
 static int              _spec_version_major = 0;
 static int              _spec_version_minor = 0;
+static gboolean         _spec_version_valid = FALSE;
+static char           **_server_caps = NULL;
+static guint            _server_caps_mask = 0;
+static gboolean         _server_has_image_fd = FALSE;
+static gint             _call_timeout = NOTIFY_CALL_TIMEOUT_DEFAULT;
+static gboolean         _adaptive_call_timeout = FALSE;
+static guint            _rtt_samples = 0;
+static gdouble          _rtt_mean = 0;
+static gdouble          _rtt_deviation = 0;
+static guint            _max_image_size = NOTIFY_DEFAULT_MAX_IMAGE_SIZE;
+static gsize            _image_spill_threshold = 0;
+static GQueue           _notification_pool = G_QUEUE_INIT;
+static guint            _notification_pool_size = 0;
+
+static const struct {
+        const char       *name;
+        NotifyCapability  cap;
+} _known_caps[] = {
+        { "action-icons",    NOTIFY_CAP_ACTION_ICONS },
+        { "actions",         NOTIFY_CAP_ACTIONS },
+        { "body",            NOTIFY_CAP_BODY },
+        { "body-hyperlinks", NOTIFY_CAP_BODY_HYPERLINKS },
+        { "body-images",     NOTIFY_CAP_BODY_IMAGES },
+        { "body-markup",     NOTIFY_CAP_BODY_MARKUP },
+        { "icon-multi",      NOTIFY_CAP_ICON_MULTI },
+        { "icon-static",     NOTIFY_CAP_ICON_STATIC },
+        { "persistence",     NOTIFY_CAP_PERSISTENCE },
+        { "sound",           NOTIFY_CAP_SOUND },
+};
+
+static void
+_notify_teardown_connection (void);
+static void
+_notify_fetch_server_caps (void);
+static void
+notify_parse_rate_limit_env (void);
+static void
+_notify_pool_drain (guint size);
 
+/*
+ * Checks the specification version the server implements, as cached when
+ * connecting. This never blocks: until then, the server is assumed to
+ * implement the current version.
+ */
 gboolean
 _notify_check_spec_version (int major,
                             int minor)
 {
+       if (!_spec_version_valid)
+               return TRUE;
+
        if (_spec_version_major > major)
                return TRUE;
        if (_spec_version_major < major)
@@ -66,30 +126,17 @@ _notify_get_server_info (char **ret_name,
                          char **ret_spec_version,
                          GError **error)
 {
-        GDBusProxy *proxy;
         GVariant   *result;
 
-        proxy = _notify_get_proxy (error);
-        if (proxy == NULL) {
-                return FALSE;
-        }
-
-        result = g_dbus_proxy_call_sync (proxy,
-                                         "GetServerInformation",
-                                         g_variant_new ("()"),
-                                         G_DBUS_CALL_FLAGS_NONE,
-                                         -1 /* FIXME shorter timeout? */,
-                                         NULL,
-                                         error);
+        result = _notify_call_sync ("GetServerInformation",
+                                    g_variant_new ("()"),
+                                    G_VARIANT_TYPE ("(ssss)"),
+                                    NOTIFY_CALL_TIMEOUT_DEFAULT,
+                                    NULL,
+                                    error);
         if (result == NULL) {
                 return FALSE;
         }
-        if (!g_variant_is_of_type (result, G_VARIANT_TYPE ("(ssss)"))) {
-                g_variant_unref (result);
-                g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                             "Unexpected reply type");
-                return FALSE;
-        }
 
         g_variant_get (result, "(ssss)",
                        ret_name,
@@ -100,6 +147,17 @@ _notify_get_server_info (char **ret_name,
         return TRUE;
 }
 
+static void
+_notify_parse_spec_version (const char *spec_version)
+{
+       sscanf (spec_version,
+               "%d.%d",
+               &_spec_version_major,
+               &_spec_version_minor);
+
+       _spec_version_valid = TRUE;
+}
+
 static gboolean
 _notify_update_spec_version (GError **error)
 {
@@ -109,10 +167,7 @@ _notify_update_spec_version (GError **error)
                return FALSE;
        }
 
-       sscanf (spec_version,
-               "%d.%d",
-               &_spec_version_major,
-               &_spec_version_minor);
+       _notify_parse_spec_version (spec_version);
 
        g_free (spec_version);
 
@@ -120,6 +175,117 @@ _notify_update_spec_version (GError **error)
 }
 
 
+static void
+_notify_set_server_caps (char **caps)
+{
+        char **cap;
+        guint  i;
+
+        g_strfreev (_server_caps);
+        _server_caps = caps;
+        _server_caps_mask = 0;
+        _server_has_image_fd = FALSE;
+
+        for (cap = caps; *cap != NULL; cap++) {
+                if (strcmp (*cap, NOTIFY_IMAGE_FD_CAPABILITY) == 0)
+                        _server_has_image_fd = TRUE;
+
+                for (i = 0; i < G_N_ELEMENTS (_known_caps); i++) {
+                        if (strcmp (*cap, _known_caps[i].name) == 0) {
+                                _server_caps_mask |= _known_caps[i].cap;
+                                break;
+                        }
+                }
+        }
+}
+
+static gboolean
+_notify_parse_server_caps (GVariant *result)
+{
+        char **caps;
+
+        if (!g_variant_is_of_type (result, G_VARIANT_TYPE ("(as)")))
+                return FALSE;
+
+        g_variant_get (result, "(^as)", &caps);
+        _notify_set_server_caps (caps);
+
+        return TRUE;
+}
+
+/*
+ * _notify_ensure_server_caps:
+ *
+ * Makes sure the capabilities of the server are cached, querying the
+ * server synchronously if they are not.
+ *
+ * Returns: %TRUE if the capabilities are known
+ */
+static gboolean
+_notify_ensure_server_caps (void)
+{
+        GVariant *result;
+        gboolean  ret;
+
+        if (_server_caps != NULL)
+                return TRUE;
+
+        if (_notify_get_connection (NULL) == NULL) {
+                g_warning ("Failed to connect to the notification server");
+                return FALSE;
+        }
+
+        result = _notify_call_sync ("GetCapabilities",
+                                    g_variant_new ("()"),
+                                    G_VARIANT_TYPE ("(as)"),
+                                    NOTIFY_CALL_TIMEOUT_DEFAULT,
+                                    NULL,
+                                    NULL);
+        if (result == NULL) {
+                return FALSE;
+        }
+
+        ret = _notify_parse_server_caps (result);
+        g_variant_unref (result);
+
+        return ret;
+}
+
+static void
+_notify_invalidate_server_cache (void)
+{
+        g_strfreev (_server_caps);
+        _server_caps = NULL;
+        _server_caps_mask = 0;
+        _server_has_image_fd = FALSE;
+        _spec_version_valid = FALSE;
+}
+
+static void
+_notify_name_owner_changed_cb (GDBusConnection *connection,
+                               const char      *sender_name,
+                               const char      *object_path,
+                               const char      *interface_name,
+                               const char      *signal_name,
+                               GVariant        *parameters,
+                               gpointer         user_data)
+{
+        const char *old_owner;
+
+        if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sss)")))
+                return;
+
+        g_variant_get (parameters, "(&s&s&s)", NULL, &old_owner, NULL);
+
+        /*
+         * Whatever was cached while the name had no owner was fetched from
+         * the server being activated, which is the new owner. Only a change
+         * away from a known owner makes the cache stale.
+         */
+        if (*old_owner != '\0')
+                _notify_invalidate_server_cache ();
+}
+
 /**
  * notify_set_app_name:
  * @app_name: The name of the application
@@ -152,16 +318,93 @@ notify_init (const char *app_name)
                 return TRUE;
 
         notify_set_app_name (app_name);
-
-#if !GLIB_CHECK_VERSION (2, 36, 0)
-        g_type_init ();
-#endif
+        notify_parse_rate_limit_env ();
 
         _initted = TRUE;
 
         return TRUE;
 }
 
+static void
+notify_init_connection_cb (GObject      *source,
+                           GAsyncResult *res,
+                           gpointer      user_data)
+{
+        GTask           *task = G_TASK (user_data);
+        GDBusConnection *connection;
+        GError          *error = NULL;
+
+        connection = _notify_get_connection_finish (res, &error);
+        if (connection == NULL) {
+                g_task_return_error (task, error);
+        } else {
+                g_object_unref (connection);
+                g_task_return_boolean (task, TRUE);
+        }
+
+        g_object_unref (task);
+}
+
+/**
+ * notify_init_async:
+ * @app_name: The name of the application initializing libnotify.
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the
+ *            connection to the notification server is ready
+ * @user_data: (closure): the data to pass to @callback
+ *
+ * Initializes libnotify like notify_init(), and then connects to the
+ * notification server in the background. This activates the server if
+ * needed and fetches the specification version it implements, so the
+ * first notification shown afterwards needs no extra round trip.
+ *
+ * libnotify is usable as soon as this function returns; the connection is
+ * simply established on first use if it is not ready by then.
+ *
+ * Since: 0.8
+ */
+void
+notify_init_async (const char         *app_name,
+                   GCancellable       *cancellable,
+                   GAsyncReadyCallback callback,
+                   gpointer            user_data)
+{
+        GTask *task;
+
+        g_return_if_fail (app_name != NULL);
+        g_return_if_fail (*app_name != '\0');
+
+        task = g_task_new (NULL, cancellable, callback, user_data);
+        g_task_set_source_tag (task, notify_init_async);
+
+        notify_init (app_name);
+
+        _notify_get_connection_async (cancellable, notify_init_connection_cb, task);
+}
+
+/**
+ * notify_init_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: The returned error information.
+ *
+ * Finishes an operation started with notify_init_async(). libnotify stays
+ * initialized even if the notification server could not be reached.
+ *
+ * Returns: %TRUE if the notification server is ready, or %FALSE on error
+ *          with @error filled in.
+ *
+ * Since: 0.8
+ */
+gboolean
+notify_init_finish (GAsyncResult *result,
+                    GError      **error)
+{
+        g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+        g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+        return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 /**
  * notify_get_app_name:
  *
@@ -197,19 +440,22 @@ notify_uninit (void)
                 _app_name = NULL;
         }
 
-        for (l = _active_notifications; l != NULL; l = l->next) {
+        for (l = _active_notifications.head; l != NULL; l = l->next) {
                 NotifyNotification *n = NOTIFY_NOTIFICATION (l->data);
 
+                _notify_notification_flush_sync (n);
+
                 if (_notify_notification_get_timeout (n) == 0 ||
                     _notify_notification_has_nondefault_actions (n)) {
                         notify_notification_close (n, NULL);
                 }
         }
 
-        if (_proxy != NULL) {
-            g_object_unref (_proxy);
-            _proxy = NULL;
-        }
+        _notify_pool_drain (0);
+        _notify_image_files_forget ();
+
+        _notify_teardown_connection ();
+        _notify_invalidate_server_cache ();
 
         _initted = FALSE;
 }
@@ -227,124 +473,2424 @@ notify_is_initted (void)
         return _initted;
 }
 
+static void
+_notify_closed_signal_cb (GDBusConnection *connection,
+                          const char      *sender_name,
+                          const char      *object_path,
+                          const char      *interface_name,
+                          const char      *signal_name,
+                          GVariant        *parameters,
+                          gpointer         user_data)
+{
+        NotifyNotification *notification;
+        guint32             id;
+        guint32             reason;
+
+        if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(uu)")))
+                return;
+
+        g_variant_get (parameters, "(uu)", &id, &reason);
+
+        _notify_image_files_closed (id);
+
+        if (_notifications_by_id == NULL)
+                return;
+
+        notification = g_hash_table_lookup (_notifications_by_id,
+                                            GUINT_TO_POINTER (id));
+        if (notification != NULL)
+                _notify_notification_emit_closed (notification, reason);
+}
+
+static void
+_notify_action_signal_cb (GDBusConnection *connection,
+                          const char      *sender_name,
+                          const char      *object_path,
+                          const char      *interface_name,
+                          const char      *signal_name,
+                          GVariant        *parameters,
+                          gpointer         user_data)
+{
+        NotifyNotification *notification;
+        guint32             id;
+        const char         *action;
+
+        if (_notifications_by_id == NULL ||
+            !g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(us)")))
+                return;
+
+        g_variant_get (parameters, "(u&s)", &id, &action);
+
+        notification = g_hash_table_lookup (_notifications_by_id,
+                                            GUINT_TO_POINTER (id));
+        if (notification != NULL)
+                _notify_notification_invoke_action (notification, action);
+}
+
+static void
+_notify_subscribe_signals (void)
+{
+        _closed_subscription =
+                g_dbus_connection_signal_subscribe (_connection,
+                                                    NOTIFY_DBUS_NAME,
+                                                    NOTIFY_DBUS_CORE_INTERFACE,
+                                                    "NotificationClosed",
+                                                    NOTIFY_DBUS_CORE_OBJECT,
+                                                    NULL,
+                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                    _notify_closed_signal_cb,
+                                                    NULL,
+                                                    NULL);
+        _action_subscription =
+                g_dbus_connection_signal_subscribe (_connection,
+                                                    NOTIFY_DBUS_NAME,
+                                                    NOTIFY_DBUS_CORE_INTERFACE,
+                                                    "ActionInvoked",
+                                                    NOTIFY_DBUS_CORE_OBJECT,
+                                                    NULL,
+                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                    _notify_action_signal_cb,
+                                                    NULL,
+                                                    NULL);
+}
+
 /*
- * _notify_get_proxy:
- * @error: (allow-none): a location to store a #GError, or %NULL
+ * _notify_update_signal_subscriptions:
  *
- * Synchronously creates the #GDBusProxy for the notification service,
- * and caches the result.
- *
- * Returns: the #GDBusProxy for the notification service, or %NULL on error
+ * Subscribes to the NotificationClosed and ActionInvoked signals if a
+ * notification listens to them, or if spilled image files wait for their
+ * notification to be closed, and unsubscribes otherwise.
  */
-GDBusProxy *
-_notify_get_proxy (GError **error)
+void
+_notify_update_signal_subscriptions (void)
 {
-        if (_proxy != NULL)
-                return _proxy;
+        gboolean wanted;
 
-        _proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
-                                                G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-                                                NULL,
-                                                NOTIFY_DBUS_NAME,
-                                                NOTIFY_DBUS_CORE_OBJECT,
-                                                NOTIFY_DBUS_CORE_INTERFACE,
-                                                NULL,
-                                                error);
-        if (_proxy == NULL) {
-                return NULL;
+        if (_connection == NULL)
+                return;
+
+        wanted = (_signal_listeners != NULL &&
+                  g_hash_table_size (_signal_listeners) > 0) ||
+                 _notify_image_files_shown ();
+
+        if (wanted && _closed_subscription == 0) {
+                _notify_subscribe_signals ();
+        } else if (!wanted && _closed_subscription != 0) {
+                g_dbus_connection_signal_unsubscribe (_connection, _closed_subscription);
+                g_dbus_connection_signal_unsubscribe (_connection, _action_subscription);
+                _closed_subscription = 0;
+                _action_subscription = 0;
         }
+}
 
-        if (!_notify_update_spec_version (error)) {
-               g_object_unref (_proxy);
-               _proxy = NULL;
-               return NULL;
+static void
+_notify_setup_connection (GDBusConnection *connection)
+{
+        _connection = connection;
+
+        /* Only the changes of our own service, filtered by the bus */
+        _name_owner_subscription =
+                g_dbus_connection_signal_subscribe (_connection,
+                                                    "org.freedesktop.DBus",
+                                                    "org.freedesktop.DBus",
+                                                    "NameOwnerChanged",
+                                                    "/org/freedesktop/DBus",
+                                                    NOTIFY_DBUS_NAME,
+                                                    G_DBUS_SIGNAL_FLAGS_NONE,
+                                                    _notify_name_owner_changed_cb,
+                                                    NULL,
+                                                    NULL);
+
+        _notify_update_signal_subscriptions ();
+}
+
+static void
+_notify_teardown_connection (void)
+{
+        if (_connection == NULL)
+                return;
+
+        if (_closed_subscription != 0) {
+                g_dbus_connection_signal_unsubscribe (_connection, _closed_subscription);
+                g_dbus_connection_signal_unsubscribe (_connection, _action_subscription);
+                _closed_subscription = 0;
+                _action_subscription = 0;
         }
 
-        g_object_add_weak_pointer (G_OBJECT (_proxy), (gpointer *) &_proxy);
+        g_dbus_connection_signal_unsubscribe (_connection, _name_owner_subscription);
+        _name_owner_subscription = 0;
 
-        return _proxy;
+        g_object_unref (_connection);
+        _connection = NULL;
 }
 
-/**
- * notify_get_server_caps:
+/*
+ * _notify_get_connection:
+ * @error: (allow-none): a location to store a #GError, or %NULL
  *
- * Synchronously queries the server for its capabilities and returns them in a #GList.
+ * Synchronously connects to the session bus, makes sure the notification
+ * service is running and caches the result. Calls and signals go straight
+ * through the #GDBusConnection, without a #GDBusProxy in between.
  *
- * Returns: (transfer full) (element-type utf8): a #GList of server capability strings. Free
- *   the list elements with g_free() and the list itself with g_list_free().
+ * Returns: (transfer none): the connection to the notification service,
+ *   or %NULL on error
  */
-GList *
-notify_get_server_caps (void)
+GDBusConnection *
+_notify_get_connection (GError **error)
 {
-        GDBusProxy *proxy;
-        GVariant   *result;
-        char      **cap, **caps;
-        GList      *list = NULL;
+        GDBusConnection *connection;
 
-        proxy = _notify_get_proxy (NULL);
-        if (proxy == NULL) {
-                g_warning ("Failed to connect to proxy");
+        if (_connection != NULL)
+                return _connection;
+
+        connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, error);
+        if (connection == NULL) {
                 return NULL;
         }
 
-        result = g_dbus_proxy_call_sync (proxy,
-                                         "GetCapabilities",
-                                         g_variant_new ("()"),
-                                         G_DBUS_CALL_FLAGS_NONE,
-                                         -1 /* FIXME shorter timeout? */,
-                                         NULL,
-                                         NULL);
-        if (result == NULL) {
+        _notify_setup_connection (connection);
+
+        if (!_notify_update_spec_version (error)) {
+                _notify_teardown_connection ();
                 return NULL;
         }
-        if (!g_variant_is_of_type (result, G_VARIANT_TYPE ("(as)"))) {
-                g_variant_unref (result);
-                return NULL;
+
+        if (_server_caps == NULL)
+                _notify_fetch_server_caps ();
+
+        return _connection;
+}
+
+static void
+_notify_complete_connection_waiters (const GError *error)
+{
+        GList *waiters, *l;
+
+        /* A waiter may ask for the connection again from its callback */
+        waiters = _connection_waiters.head;
+        g_queue_init (&_connection_waiters);
+
+        for (l = waiters; l != NULL; l = l->next) {
+                GTask *task = G_TASK (l->data);
+
+                if (error != NULL) {
+                        g_task_return_error (task, g_error_copy (error));
+                } else {
+                        g_task_return_pointer (task,
+                                               g_object_ref (_connection),
+                                               g_object_unref);
+                }
+                g_object_unref (task);
         }
 
-        g_variant_get (result, "(^as)", &caps);
+        g_list_free (waiters);
+}
 
-        for (cap = caps; *cap != NULL; cap++) {
-                list = g_list_prepend (list, *cap);
+static void
+_notify_connection_caps_cb (GObject      *source,
+                            GAsyncResult *res,
+                            gpointer      user_data)
+{
+        GVariant *result;
+
+        result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source),
+                                                res,
+                                                NULL);
+        if (result == NULL)
+                return;
+
+        if (_server_caps == NULL)
+                _notify_parse_server_caps (result);
+
+        g_variant_unref (result);
+}
+
+/* Fills the capabilities cache in the background */
+static void
+_notify_fetch_server_caps (void)
+{
+        g_dbus_connection_call (_connection,
+                                NOTIFY_DBUS_NAME,
+                                NOTIFY_DBUS_CORE_OBJECT,
+                                NOTIFY_DBUS_CORE_INTERFACE,
+                                "GetCapabilities",
+                                g_variant_new ("()"),
+                                G_VARIANT_TYPE ("(as)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                _notify_resolve_call_timeout (NOTIFY_CALL_TIMEOUT_DEFAULT),
+                                NULL,
+                                _notify_connection_caps_cb,
+                                NULL);
+}
+
+static void
+_notify_connection_server_info_cb (GObject      *source,
+                                   GAsyncResult *res,
+                                   gpointer      user_data)
+{
+        GDBusConnection *connection = G_DBUS_CONNECTION (source);
+        GVariant        *result;
+        GError          *error = NULL;
+
+        result = g_dbus_connection_call_finish (connection, res, &error);
+        if (result == NULL) {
+                g_object_unref (connection);
+                _notify_complete_connection_waiters (error);
+                g_error_free (error);
+                return;
+        }
+
+        if (_connection == NULL) {
+                const char *spec_version;
+
+                g_variant_get (result, "(&s&s&s&s)",
+                               NULL, NULL, NULL, &spec_version);
+                _notify_parse_spec_version (spec_version);
+
+                _notify_setup_connection (connection);
+
+                if (_server_caps == NULL)
+                        _notify_fetch_server_caps ();
+        } else {
+                /* Connected synchronously in the meantime */
+                g_object_unref (connection);
         }
 
-        g_free (caps);
         g_variant_unref (result);
+        _notify_complete_connection_waiters (NULL);
+}
 
-        return g_list_reverse (list);
+static void
+_notify_bus_get_cb (GObject      *source,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+        GDBusConnection *connection;
+        GError          *error = NULL;
+
+        connection = g_bus_get_finish (res, &error);
+        if (connection == NULL) {
+                _notify_complete_connection_waiters (error);
+                g_error_free (error);
+                return;
+        }
+
+        /* This also activates the notification daemon if needed */
+        g_dbus_connection_call (connection,
+                                NOTIFY_DBUS_NAME,
+                                NOTIFY_DBUS_CORE_OBJECT,
+                                NOTIFY_DBUS_CORE_INTERFACE,
+                                "GetServerInformation",
+                                g_variant_new ("()"),
+                                G_VARIANT_TYPE ("(ssss)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                _notify_resolve_call_timeout (NOTIFY_CALL_TIMEOUT_DEFAULT),
+                                NULL,
+                                _notify_connection_server_info_cb,
+                                NULL);
 }
 
-/**
- * notify_get_server_info:
- * @ret_name: (out) (allow-none) (transfer full): a location to store the server name, or %NULL
- * @ret_vendor: (out) (allow-none) (transfer full): a location to store the server vendor, or %NULL
- * @ret_version: (out) (allow-none) (transfer full): a location to store the server version, or %NULL
- * @ret_spec_version: (out) (allow-none) (transfer full): a location to store the version the service is compliant with, or %NULL
+/*
+ * _notify_get_connection_async:
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback
+ * @user_data: the data to pass to @callback
  *
- * Synchronously queries the server for its information, specifically, the name, vendor,
- * server version, and the version of the notifications specification that it
- * is compliant with.
+ * Asynchronously connects to the notification service and fetches the
+ * specification version the server implements, without blocking the
+ * caller. Concurrent requests share a single round trip.
+ */
+void
+_notify_get_connection_async (GCancellable       *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer            user_data)
+{
+        GTask *task;
+
+        task = g_task_new (NULL, cancellable, callback, user_data);
+        g_task_set_source_tag (task, _notify_get_connection_async);
+
+        if (_connection != NULL) {
+                g_task_return_pointer (task,
+                                       g_object_ref (_connection),
+                                       g_object_unref);
+                g_object_unref (task);
+                return;
+        }
+
+        g_queue_push_tail (&_connection_waiters, task);
+        if (g_queue_get_length (&_connection_waiters) > 1)
+                return;
+
+        g_bus_get (G_BUS_TYPE_SESSION, NULL, _notify_bus_get_cb, NULL);
+}
+
+/*
+ * _notify_get_connection_finish:
  *
- * Returns: %TRUE if successful, and the variables passed will be set, %FALSE
- *          on error. The returned strings must be freed with g_free
+ * Returns: (transfer full): the connection to the notification service,
+ *   or %NULL on error
  */
-gboolean
-notify_get_server_info (char **ret_name,
-                        char **ret_vendor,
-                        char **ret_version,
-                        char **ret_spec_version)
+GDBusConnection *
+_notify_get_connection_finish (GAsyncResult *result,
+                               GError      **error)
 {
-        return _notify_get_server_info (ret_name, ret_vendor, ret_version, ret_spec_version, NULL);
+        g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+        return g_task_propagate_pointer (G_TASK (result), error);
 }
 
+/**
+ * notify_set_call_timeout:
+ * @timeout: the deadline in milliseconds, or %NOTIFY_CALL_TIMEOUT_DEFAULT
+ *
+ * Sets how long libnotify waits for the notification server to answer a
+ * request before giving up with a %G_IO_ERROR_TIMED_OUT error. This
+ * bounds how long a hung server can block the synchronous functions.
+ *
+ * Passing %NOTIFY_CALL_TIMEOUT_DEFAULT restores the D-Bus default of
+ * about 25 seconds. A deadline set on a notification with
+ * notify_notification_set_call_timeout() takes precedence.
+ *
+ * Since: 0.8
+ */
 void
-_notify_cache_add_notification (NotifyNotification *n)
+notify_set_call_timeout (gint timeout)
+{
+        g_return_if_fail (timeout > 0 || timeout == NOTIFY_CALL_TIMEOUT_DEFAULT);
+
+        _call_timeout = timeout;
+}
+
+/**
+ * notify_get_call_timeout:
+ *
+ * Gets the deadline set with notify_set_call_timeout().
+ *
+ * Returns: the deadline in milliseconds, or %NOTIFY_CALL_TIMEOUT_DEFAULT
+ *
+ * Since: 0.8
+ */
+gint
+notify_get_call_timeout (void)
 {
-        _active_notifications = g_list_prepend (_active_notifications, n);
+        return _call_timeout;
 }
 
+/**
+ * notify_set_adaptive_call_timeout:
+ * @adaptive: whether to derive deadlines from the observed round-trip times
+ *
+ * When enabled, requests that have no explicit deadline use one derived
+ * from an exponentially weighted moving average of the round-trip times
+ * observed so far, plus four times their mean deviation, so that a
+ * stalled server is detected quickly when it normally answers fast. The
+ * deadline set with notify_set_call_timeout(), if any, is the upper bound.
+ *
+ * Since: 0.8
+ */
 void
-_notify_cache_remove_notification (NotifyNotification *n)
+notify_set_adaptive_call_timeout (gboolean adaptive)
 {
-        _active_notifications = g_list_remove (_active_notifications, n);
+        _adaptive_call_timeout = adaptive;
+}
+
+/*
+ * _notify_resolve_call_timeout:
+ * @timeout: the deadline requested for the call, or
+ *   %NOTIFY_CALL_TIMEOUT_DEFAULT
+ *
+ * Returns: the timeout to pass to GDBus for a call
+ */
+gint
+_notify_resolve_call_timeout (gint timeout)
+{
+        gint max_timeout;
+
+        if (timeout > 0)
+                return timeout;
+
+        if (!_adaptive_call_timeout || _rtt_samples == 0)
+                return _call_timeout;
+
+        max_timeout = _call_timeout > 0 ? _call_timeout : NOTIFY_ADAPTIVE_TIMEOUT_MAX;
+        timeout = (gint) (_rtt_mean + 4 * _rtt_deviation);
+
+        return CLAMP (timeout, MIN (NOTIFY_ADAPTIVE_TIMEOUT_MIN, max_timeout), max_timeout);
+}
+
+static void
+_notify_record_round_trip (gint64        start_time,
+                           GVariant     *result,
+                           const GError *error)
+{
+        gdouble sample;
+
+        /*
+         * A call that timed out still tells us the server is at least
+         * this slow, which lets the deadline grow during a stall.
+         */
+        if (result == NULL &&
+            !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+                return;
+
+        sample = (g_get_monotonic_time () - start_time) / 1000.0;
+
+        /* The estimators TCP uses for its retransmission timeout */
+        if (_rtt_samples == 0) {
+                _rtt_mean = sample;
+                _rtt_deviation = sample / 2;
+        } else {
+                _rtt_deviation = 0.75 * _rtt_deviation + 0.25 * ABS (_rtt_mean - sample);
+                _rtt_mean = 0.875 * _rtt_mean + 0.125 * sample;
+        }
+
+        if (_rtt_samples < G_MAXUINT)
+                _rtt_samples++;
+}
+
+/*
+ * _notify_call_sync:
+ * @method: the method of the notification service to call
+ * @parameters: the parameters of the call; consumed if floating
+ * @reply_type: the type the reply must have
+ * @timeout: the deadline of the call in milliseconds, or
+ *   %NOTIFY_CALL_TIMEOUT_DEFAULT
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @error: (allow-none): a location to store a #GError, or %NULL
+ *
+ * Synchronously calls @method on the notification service.
+ *
+ * Returns: the reply, or %NULL on error
+ */
+GVariant *
+_notify_call_sync (const char         *method,
+                   GVariant           *parameters,
+                   const GVariantType *reply_type,
+                   gint                timeout,
+                   GCancellable       *cancellable,
+                   GError            **error)
+{
+        return _notify_call_with_unix_fd_list_sync (method,
+                                                    parameters,
+                                                    NULL,
+                                                    reply_type,
+                                                    timeout,
+                                                    cancellable,
+                                                    error);
+}
+
+/*
+ * _notify_call_with_unix_fd_list_sync:
+ * @fd_list: (allow-none): the file descriptors to send along, or %NULL
+ *
+ * Like _notify_call_sync(), also passing the file descriptors in
+ * @fd_list, referred to by handles in @parameters.
+ */
+GVariant *
+_notify_call_with_unix_fd_list_sync (const char         *method,
+                                     GVariant           *parameters,
+                                     GUnixFDList        *fd_list,
+                                     const GVariantType *reply_type,
+                                     gint                timeout,
+                                     GCancellable       *cancellable,
+                                     GError            **error)
+{
+        GDBusConnection *connection;
+        GVariant        *result;
+        GError          *local_error = NULL;
+        gint64           start_time;
+
+        g_variant_ref_sink (parameters);
+
+        connection = _notify_get_connection (error);
+        if (connection == NULL) {
+                g_variant_unref (parameters);
+                return NULL;
+        }
+
+        start_time = g_get_monotonic_time ();
+        result = g_dbus_connection_call_with_unix_fd_list_sync (connection,
+                                                                NOTIFY_DBUS_NAME,
+                                                                NOTIFY_DBUS_CORE_OBJECT,
+                                                                NOTIFY_DBUS_CORE_INTERFACE,
+                                                                method,
+                                                                parameters,
+                                                                reply_type,
+                                                                G_DBUS_CALL_FLAGS_NONE,
+                                                                _notify_resolve_call_timeout (timeout),
+                                                                fd_list,
+                                                                NULL,
+                                                                cancellable,
+                                                                &local_error);
+        g_variant_unref (parameters);
+
+        _notify_record_round_trip (start_time, result, local_error);
+
+        if (result == NULL) {
+                g_propagate_error (error, local_error);
+                return NULL;
+        }
+
+        return result;
+}
+
+typedef struct
+{
+        const char         *method;
+        GVariant           *parameters;
+        GUnixFDList        *fd_list;
+        const GVariantType *reply_type;
+        gint                timeout;
+        gint64              start_time;
+} NotifyCall;
+
+static void
+_notify_call_free (NotifyCall *call)
+{
+        g_variant_unref (call->parameters);
+        if (call->fd_list != NULL)
+                g_object_unref (call->fd_list);
+        g_free (call);
+}
+
+static void
+_notify_call_cb (GObject      *source,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+        GTask      *task = G_TASK (user_data);
+        NotifyCall *call = g_task_get_task_data (task);
+        GVariant   *result;
+        GError     *error = NULL;
+
+        result = g_dbus_connection_call_with_unix_fd_list_finish (G_DBUS_CONNECTION (source),
+                                                                  NULL,
+                                                                  res,
+                                                                  &error);
+        _notify_record_round_trip (call->start_time, result, error);
+
+        if (result != NULL) {
+                g_task_return_pointer (task, result,
+                                       (GDestroyNotify) g_variant_unref);
+        } else {
+                g_task_return_error (task, error);
+        }
+
+        g_object_unref (task);
+}
+
+static void
+_notify_call_start (GTask           *task,
+                    GDBusConnection *connection)
+{
+        NotifyCall *call = g_task_get_task_data (task);
+
+        call->start_time = g_get_monotonic_time ();
+        g_dbus_connection_call_with_unix_fd_list (connection,
+                                                  NOTIFY_DBUS_NAME,
+                                                  NOTIFY_DBUS_CORE_OBJECT,
+                                                  NOTIFY_DBUS_CORE_INTERFACE,
+                                                  call->method,
+                                                  call->parameters,
+                                                  call->reply_type,
+                                                  G_DBUS_CALL_FLAGS_NONE,
+                                                  _notify_resolve_call_timeout (call->timeout),
+                                                  call->fd_list,
+                                                  g_task_get_cancellable (task),
+                                                  _notify_call_cb,
+                                                  task);
+}
+
+static void
+_notify_call_connection_cb (GObject      *source,
+                            GAsyncResult *res,
+                            gpointer      user_data)
+{
+        GTask           *task = G_TASK (user_data);
+        GDBusConnection *connection;
+        GError          *error = NULL;
+
+        connection = _notify_get_connection_finish (res, &error);
+        if (connection == NULL) {
+                g_task_return_error (task, error);
+                g_object_unref (task);
+                return;
+        }
+
+        _notify_call_start (task, connection);
+        g_object_unref (connection);
+}
+
+/*
+ * _notify_call:
+ * @method: the method of the notification service to call; must be a
+ *   static string
+ * @parameters: the parameters of the call; consumed if floating
+ * @reply_type: the type the reply must have; must be static
+ * @timeout: the deadline of the call in milliseconds, or
+ *   %NOTIFY_CALL_TIMEOUT_DEFAULT
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously calls @method on the notification service. The call is
+ * sent right away if the connection is up, and otherwise as soon as it
+ * has been established.
+ */
+void
+_notify_call (const char         *method,
+              GVariant           *parameters,
+              const GVariantType *reply_type,
+              gint                timeout,
+              GCancellable       *cancellable,
+              GAsyncReadyCallback callback,
+              gpointer            user_data)
+{
+        _notify_call_with_unix_fd_list (method,
+                                        parameters,
+                                        NULL,
+                                        reply_type,
+                                        timeout,
+                                        cancellable,
+                                        callback,
+                                        user_data);
+}
+
+/*
+ * _notify_call_with_unix_fd_list:
+ * @fd_list: (allow-none): the file descriptors to send along, or %NULL
+ *
+ * Like _notify_call(), also passing the file descriptors in @fd_list,
+ * referred to by handles in @parameters. Finish with
+ * _notify_call_finish().
+ */
+void
+_notify_call_with_unix_fd_list (const char         *method,
+                                GVariant           *parameters,
+                                GUnixFDList        *fd_list,
+                                const GVariantType *reply_type,
+                                gint                timeout,
+                                GCancellable       *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer            user_data)
+{
+        NotifyCall *call;
+        GTask      *task;
+
+        task = g_task_new (NULL, cancellable, callback, user_data);
+        g_task_set_source_tag (task, _notify_call);
+
+        call = g_new0 (NotifyCall, 1);
+        call->method = method;
+        call->parameters = g_variant_ref_sink (parameters);
+        call->fd_list = fd_list != NULL ? g_object_ref (fd_list) : NULL;
+        call->reply_type = reply_type;
+        call->timeout = timeout;
+        g_task_set_task_data (task, call, (GDestroyNotify) _notify_call_free);
+
+        if (_connection != NULL) {
+                _notify_call_start (task, _connection);
+        } else {
+                _notify_get_connection_async (cancellable, _notify_call_connection_cb, task);
+        }
+}
+
+/*
+ * _notify_call_finish:
+ *
+ * Returns: the reply of a call started with _notify_call(), or %NULL on
+ *   error
+ */
+GVariant *
+_notify_call_finish (GAsyncResult *result,
+                     GError      **error)
+{
+        g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+        return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * notify_get_server_caps:
+ *
+ * Queries the server for its capabilities and returns them in a #GList.
+ *
+ * The capabilities are fetched synchronously the first time and then
+ * cached until the notification server is replaced.
+ *
+ * Returns: (transfer full) (element-type utf8): a #GList of server capability strings. Free
+ *   the list elements with g_free() and the list itself with g_list_free().
+ */
+GList *
+notify_get_server_caps (void)
+{
+        char      **cap;
+        GList      *list = NULL;
+
+        if (!_notify_ensure_server_caps ()) {
+                return NULL;
+        }
+
+        for (cap = _server_caps; *cap != NULL; cap++) {
+                list = g_list_prepend (list, g_strdup (*cap));
+        }
+
+        return g_list_reverse (list);
+}
+
+/**
+ * notify_server_has_capability:
+ * @capability: the #NotifyCapability flags to check
+ *
+ * Checks whether the notification server implements all of the
+ * capabilities in @capability. This uses the same cache as
+ * notify_get_server_caps(), so it only contacts the server when the
+ * capabilities are not known yet.
+ *
+ * Returns: %TRUE if the server implements every capability in @capability
+ *
+ * Since: 0.8
+ */
+gboolean
+notify_server_has_capability (NotifyCapability capability)
+{
+        if (!_notify_ensure_server_caps ()) {
+                return FALSE;
+        }
+
+        return (_server_caps_mask & capability) == capability;
+}
+
+/*
+ * _notify_server_has_image_fd:
+ *
+ * Checks the cached capabilities only, so this never blocks. Until they
+ * are known, images are sent inline.
+ *
+ * Returns: %TRUE if images can be passed to the server as file
+ *   descriptors, see %NOTIFY_IMAGE_FD_CAPABILITY
+ */
+gboolean
+_notify_server_has_image_fd (void)
+{
+        if (_server_caps == NULL || !_server_has_image_fd)
+                return FALSE;
+
+        return _connection != NULL &&
+               (g_dbus_connection_get_capabilities (_connection) &
+                G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING) != 0;
+}
+
+static void
+notify_get_server_caps_cb (GObject      *source,
+                           GAsyncResult *res,
+                           gpointer      user_data)
+{
+        GTask    *task = G_TASK (user_data);
+        GVariant *result;
+        GError   *error = NULL;
+
+        result = _notify_call_finish (res, &error);
+        if (result == NULL) {
+                g_task_return_error (task, error);
+        } else {
+                _notify_parse_server_caps (result);
+                g_variant_unref (result);
+                g_task_return_boolean (task, TRUE);
+        }
+
+        g_object_unref (task);
+}
+
+/**
+ * notify_get_server_caps_async:
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the
+ *            capabilities are known
+ * @user_data: (closure): the data to pass to @callback
+ *
+ * Asynchronously queries the server for its capabilities. This is the
+ * non-blocking version of notify_get_server_caps(), and is answered from
+ * the cache when possible.
+ *
+ * Since: 0.8
+ */
+void
+notify_get_server_caps_async (GCancellable       *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer            user_data)
+{
+        GTask *task;
+
+        task = g_task_new (NULL, cancellable, callback, user_data);
+        g_task_set_source_tag (task, notify_get_server_caps_async);
+
+        if (_server_caps != NULL) {
+                g_task_return_boolean (task, TRUE);
+                g_object_unref (task);
+                return;
+        }
+
+        _notify_call ("GetCapabilities",
+                      g_variant_new ("()"),
+                      G_VARIANT_TYPE ("(as)"),
+                      NOTIFY_CALL_TIMEOUT_DEFAULT,
+                      cancellable,
+                      notify_get_server_caps_cb,
+                      task);
+}
+
+/**
+ * notify_get_server_caps_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: The returned error information.
+ *
+ * Finishes an operation started with notify_get_server_caps_async().
+ *
+ * Returns: (transfer full) (element-type utf8): a #GList of server capability strings,
+ *   or %NULL on error. Free the list elements with g_free() and the list itself
+ *   with g_list_free().
+ *
+ * Since: 0.8
+ */
+GList *
+notify_get_server_caps_finish (GAsyncResult *result,
+                               GError      **error)
+{
+        GList      *list = NULL;
+        char      **cap;
+
+        g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+        g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+        if (!g_task_propagate_boolean (G_TASK (result), error)) {
+                return NULL;
+        }
+
+        /* The server may have gone away again in the meantime */
+        if (_server_caps == NULL) {
+                return NULL;
+        }
+
+        for (cap = _server_caps; *cap != NULL; cap++) {
+                list = g_list_prepend (list, g_strdup (*cap));
+        }
+
+        return g_list_reverse (list);
+}
+
+/**
+ * notify_get_server_info:
+ * @ret_name: (out) (allow-none) (transfer full): a location to store the server name, or %NULL
+ * @ret_vendor: (out) (allow-none) (transfer full): a location to store the server vendor, or %NULL
+ * @ret_version: (out) (allow-none) (transfer full): a location to store the server version, or %NULL
+ * @ret_spec_version: (out) (allow-none) (transfer full): a location to store the version the service is compliant with, or %NULL
+ *
+ * Synchronously queries the server for its information, specifically, the name, vendor,
+ * server version, and the version of the notifications specification that it
+ * is compliant with.
+ *
+ * Returns: %TRUE if successful, and the variables passed will be set, %FALSE
+ *          on error. The returned strings must be freed with g_free
+ */
+gboolean
+notify_get_server_info (char **ret_name,
+                        char **ret_vendor,
+                        char **ret_version,
+                        char **ret_spec_version)
+{
+        return _notify_get_server_info (ret_name, ret_vendor, ret_version, ret_spec_version, NULL);
+}
+
+typedef void     (*NotifyBatchStartFunc)  (NotifyNotification  *notification,
+                                          GCancellable        *cancellable,
+                                          GAsyncReadyCallback  callback,
+                                          gpointer             user_data);
+typedef gboolean (*NotifyBatchFinishFunc) (NotifyNotification  *notification,
+                                          GAsyncResult        *result,
+                                          GError             **error);
+
+typedef struct
+{
+        GTask                *task;
+        guint                 index;
+} NotifyBatchItem;
+
+typedef struct
+{
+        NotifyBatchFinishFunc finish;
+        NotifyBatchItem      *items;
+        GPtrArray            *errors;
+        guint                 n_pending;
+} NotifyBatch;
+
+static void
+notify_batch_error_free (gpointer data)
+{
+        if (data != NULL)
+                g_error_free (data);
+}
+
+static void
+notify_batch_free (NotifyBatch *batch)
+{
+        if (batch->errors != NULL)
+                g_ptr_array_unref (batch->errors);
+
+        g_free (batch->items);
+        g_free (batch);
+}
+
+static void
+notify_batch_item_cb (GObject      *source,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+        NotifyBatchItem *item = user_data;
+        GTask           *task = item->task;
+        NotifyBatch     *batch = g_task_get_task_data (task);
+        GError          *error = NULL;
+
+        if (!batch->finish (NOTIFY_NOTIFICATION (source), res, &error))
+                g_ptr_array_index (batch->errors, item->index) = error;
+
+        if (--batch->n_pending > 0)
+                return;
+
+        g_task_return_pointer (task,
+                               g_ptr_array_ref (batch->errors),
+                               (GDestroyNotify) g_ptr_array_unref);
+        g_object_unref (task);
+}
+
+/*
+ * notify_batch_run:
+ *
+ * Starts @start on every notification in @notifications without waiting
+ * for any of the replies, so that all the method calls are queued on the
+ * connection back to back. @task completes once every reply has been
+ * collected by @finish.
+ */
+static void
+notify_batch_run (NotifyNotification   **notifications,
+                  guint                  n_notifications,
+                  NotifyBatchStartFunc   start,
+                  NotifyBatchFinishFunc  finish,
+                  GCancellable          *cancellable,
+                  GAsyncReadyCallback    callback,
+                  gpointer               user_data,
+                  gpointer               source_tag)
+{
+        NotifyBatch *batch;
+        GTask       *task;
+        guint        i;
+
+        task = g_task_new (NULL, cancellable, callback, user_data);
+        g_task_set_source_tag (task, source_tag);
+
+        batch = g_new0 (NotifyBatch, 1);
+        batch->finish = finish;
+        batch->items = g_new0 (NotifyBatchItem, n_notifications);
+        batch->errors = g_ptr_array_new_full (n_notifications,
+                                              notify_batch_error_free);
+        g_ptr_array_set_size (batch->errors, n_notifications);
+        batch->n_pending = n_notifications;
+        g_task_set_task_data (task, batch, (GDestroyNotify) notify_batch_free);
+
+        if (n_notifications == 0) {
+                g_task_return_pointer (task,
+                                       g_ptr_array_ref (batch->errors),
+                                       (GDestroyNotify) g_ptr_array_unref);
+                g_object_unref (task);
+                return;
+        }
+
+        for (i = 0; i < n_notifications; i++) {
+                batch->items[i].task = task;
+                batch->items[i].index = i;
+
+                start (notifications[i], cancellable,
+                       notify_batch_item_cb, &batch->items[i]);
+        }
+}
+
+static gboolean
+notify_batch_finish (GAsyncResult  *result,
+                     gpointer       source_tag,
+                     GPtrArray    **errors,
+                     GError       **error)
+{
+        GPtrArray *item_errors;
+        gboolean   ret = TRUE;
+        guint      i;
+
+        g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+        g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == source_tag, FALSE);
+        g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+        item_errors = g_task_propagate_pointer (G_TASK (result), error);
+        if (item_errors == NULL)
+                return FALSE;
+
+        for (i = 0; i < item_errors->len; i++) {
+                GError *item_error = g_ptr_array_index (item_errors, i);
+
+                if (item_error != NULL) {
+                        if (ret)
+                                g_propagate_error (error, g_error_copy (item_error));
+                        ret = FALSE;
+                }
+        }
+
+        if (errors != NULL)
+                *errors = item_errors;
+        else
+                g_ptr_array_unref (item_errors);
+
+        return ret;
+}
+
+/**
+ * notify_show_many:
+ * @notifications: (array length=n_notifications): the notifications to show
+ * @n_notifications: the number of notifications in @notifications
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when all the
+ *            notifications have been handled
+ * @user_data: (closure): the data to pass to @callback
+ *
+ * Asynchronously tells the notification server to display all of
+ * @notifications. Every Notify call is written to the connection before
+ * any reply is waited for, and each notification is assigned its ID as
+ * soon as its own reply arrives. The batch bypasses the send queue, see
+ * notify_set_send_queue_depth(), so it is never held back or rejected
+ * for other notifications awaiting their reply.
+ *
+ * When the operation is finished, @callback will be called. You can then
+ * call notify_show_many_finish() to get the result of the operation.
+ *
+ * Since: 0.8
+ */
+void
+notify_show_many (NotifyNotification **notifications,
+                  guint                n_notifications,
+                  GCancellable        *cancellable,
+                  GAsyncReadyCallback  callback,
+                  gpointer             user_data)
+{
+        g_return_if_fail (notifications != NULL || n_notifications == 0);
+
+        notify_batch_run (notifications,
+                          n_notifications,
+                          _notify_notification_show_batched,
+                          notify_notification_show_finish,
+                          cancellable,
+                          callback,
+                          user_data,
+                          notify_show_many);
+}
+
+/**
+ * notify_show_many_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @errors: (out) (allow-none) (transfer full) (element-type GLib.Error): a
+ *          location to store an array holding one entry per notification,
+ *          which is %NULL if that notification was shown successfully, or
+ *          %NULL
+ * @error: The returned error information.
+ *
+ * Finishes an operation started with notify_show_many(). A failure to
+ * show one notification does not stop the others from being shown.
+ *
+ * Returns: %TRUE if every notification was shown. Otherwise %FALSE is
+ *          returned and @error is set to the first failure.
+ *
+ * Since: 0.8
+ */
+gboolean
+notify_show_many_finish (GAsyncResult *result,
+                         GPtrArray   **errors,
+                         GError      **error)
+{
+        return notify_batch_finish (result, notify_show_many, errors, error);
+}
+
+/**
+ * notify_close_many:
+ * @notifications: (array length=n_notifications): the notifications to close
+ * @n_notifications: the number of notifications in @notifications
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when all the
+ *            notifications have been handled
+ * @user_data: (closure): the data to pass to @callback
+ *
+ * Asynchronously tells the notification server to hide all of
+ * @notifications. Every request is sent before any reply is waited for,
+ * so closing a batch of notifications costs about one round trip.
+ *
+ * When the operation is finished, @callback will be called. You can then
+ * call notify_close_many_finish() to get the result of the operation.
+ *
+ * Since: 0.8
+ */
+void
+notify_close_many (NotifyNotification **notifications,
+                   guint                n_notifications,
+                   GCancellable        *cancellable,
+                   GAsyncReadyCallback  callback,
+                   gpointer             user_data)
+{
+        g_return_if_fail (notifications != NULL || n_notifications == 0);
+
+        notify_batch_run (notifications,
+                          n_notifications,
+                          notify_notification_close_async,
+                          notify_notification_close_finish,
+                          cancellable,
+                          callback,
+                          user_data,
+                          notify_close_many);
+}
+
+/**
+ * notify_close_many_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @errors: (out) (allow-none) (transfer full) (element-type GLib.Error): a
+ *          location to store an array holding one entry per notification,
+ *          which is %NULL if that notification was closed successfully, or
+ *          %NULL
+ * @error: The returned error information.
+ *
+ * Finishes an operation started with notify_close_many(). A failure to
+ * close one notification does not stop the others from being closed.
+ *
+ * Returns: %TRUE if every notification was closed. Otherwise %FALSE is
+ *          returned and @error is set to the first failure.
+ *
+ * Since: 0.8
+ */
+gboolean
+notify_close_many_finish (GAsyncResult *result,
+                          GPtrArray   **errors,
+                          GError      **error)
+{
+        return notify_batch_finish (result, notify_close_many, errors, error);
+}
+
+static void
+notify_get_server_info_cb (GObject      *source,
+                           GAsyncResult *res,
+                           gpointer      user_data)
+{
+        GTask    *task = G_TASK (user_data);
+        GVariant *result;
+        GError   *error = NULL;
+
+        result = _notify_call_finish (res, &error);
+        if (result == NULL) {
+                g_task_return_error (task, error);
+        } else {
+                g_task_return_pointer (task, result,
+                                       (GDestroyNotify) g_variant_unref);
+        }
+
+        g_object_unref (task);
+}
+
+/**
+ * notify_get_server_info_async:
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the
+ *            information is known
+ * @user_data: (closure): the data to pass to @callback
+ *
+ * Asynchronously queries the server for its information. This is the
+ * non-blocking version of notify_get_server_info().
+ *
+ * Since: 0.8
+ */
+void
+notify_get_server_info_async (GCancellable       *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer            user_data)
+{
+        GTask *task;
+
+        task = g_task_new (NULL, cancellable, callback, user_data);
+        g_task_set_source_tag (task, notify_get_server_info_async);
+
+        _notify_call ("GetServerInformation",
+                      g_variant_new ("()"),
+                      G_VARIANT_TYPE ("(ssss)"),
+                      NOTIFY_CALL_TIMEOUT_DEFAULT,
+                      cancellable,
+                      notify_get_server_info_cb,
+                      task);
+}
+
+/**
+ * notify_get_server_info_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @ret_name: (out) (allow-none) (transfer full): a location to store the server name, or %NULL
+ * @ret_vendor: (out) (allow-none) (transfer full): a location to store the server vendor, or %NULL
+ * @ret_version: (out) (allow-none) (transfer full): a location to store the server version, or %NULL
+ * @ret_spec_version: (out) (allow-none) (transfer full): a location to store the version the service is compliant with, or %NULL
+ * @error: The returned error information.
+ *
+ * Finishes an operation started with notify_get_server_info_async().
+ *
+ * Returns: %TRUE if successful, and the variables passed will be set, %FALSE
+ *          on error. The returned strings must be freed with g_free
+ *
+ * Since: 0.8
+ */
+gboolean
+notify_get_server_info_finish (GAsyncResult *result,
+                               char        **ret_name,
+                               char        **ret_vendor,
+                               char        **ret_version,
+                               char        **ret_spec_version,
+                               GError      **error)
+{
+        GVariant *info;
+
+        g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+        g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+        info = g_task_propagate_pointer (G_TASK (result), error);
+        if (info == NULL) {
+                return FALSE;
+        }
+
+        g_variant_get (info, "(ssss)",
+                       ret_name,
+                       ret_vendor,
+                       ret_version,
+                       ret_spec_version);
+        g_variant_unref (info);
+
+        return TRUE;
+}
+
+/* How many summaries a merged notification lists */
+#define NOTIFY_RATE_LIMIT_MERGED_LINES 5
+
+typedef struct
+{
+        char                 *category;
+        guint                 rate;
+        guint                 burst;
+        NotifyRateLimitPolicy policy;
+
+        /* Token bucket */
+        gdouble               tokens;
+        gint64                last_refill;
+
+        guint                 suppressed;
+
+        /* Notifications waiting for a token, for NOTIFY_RATE_LIMIT_DROP_OLDEST */
+        GQueue                queued;
+
+        /* Notifications folded into a summary, for NOTIFY_RATE_LIMIT_MERGE */
+        guint                 merged;
+        GString              *merged_body;
+
+        guint                 release_source;
+} NotifyRateLimit;
+
+static NotifyRateLimit *_rate_limit = NULL;
+static GHashTable      *_category_rate_limits = NULL;
+static gboolean         _rate_limit_env_parsed = FALSE;
+
+static const struct {
+        const char           *name;
+        NotifyRateLimitPolicy policy;
+} _rate_limit_policies[] = {
+        { "drop-newest", NOTIFY_RATE_LIMIT_DROP_NEWEST },
+        { "drop-oldest", NOTIFY_RATE_LIMIT_DROP_OLDEST },
+        { "merge",       NOTIFY_RATE_LIMIT_MERGE },
+};
+
+static NotifyRateLimit *
+notify_rate_limit_new (const char           *category,
+                       guint                 rate,
+                       guint                 burst,
+                       NotifyRateLimitPolicy policy)
+{
+        NotifyRateLimit *limit;
+
+        limit = g_new0 (NotifyRateLimit, 1);
+        limit->category = g_strdup (category);
+        limit->rate = rate;
+        limit->burst = burst > 0 ? burst : rate;
+        limit->policy = policy;
+        limit->tokens = limit->burst;
+        limit->last_refill = g_get_monotonic_time ();
+        g_queue_init (&limit->queued);
+        limit->merged_body = g_string_new (NULL);
+
+        return limit;
+}
+
+static void
+notify_rate_limit_refill (NotifyRateLimit *limit)
+{
+        gint64 now = g_get_monotonic_time ();
+
+        limit->tokens += (gdouble) (now - limit->last_refill) * limit->rate / G_USEC_PER_SEC;
+        limit->tokens = MIN (limit->tokens, limit->burst);
+        limit->last_refill = now;
+}
+
+static void
+notify_rate_limit_send_merged (NotifyRateLimit *limit)
+{
+        NotifyNotification *n;
+        char               *summary;
+
+        if (limit->merged == 1)
+                summary = g_strdup ("1 more notification");
+        else
+                summary = g_strdup_printf ("%u more notifications", limit->merged);
+
+        n = notify_notification_new (summary, limit->merged_body->str, NULL);
+        notify_notification_set_category (n, limit->category);
+        _notify_notification_send (n);
+        g_object_unref (n);
+        g_free (summary);
+
+        limit->merged = 0;
+        g_string_truncate (limit->merged_body, 0);
+}
+
+/* Sends one notification held back by @limit, if any */
+static gboolean
+notify_rate_limit_release_one (NotifyRateLimit *limit)
+{
+        NotifyNotification *n;
+
+        if (limit->merged > 0) {
+                notify_rate_limit_send_merged (limit);
+                return TRUE;
+        }
+
+        n = g_queue_pop_head (&limit->queued);
+        if (n == NULL)
+                return FALSE;
+
+        _notify_notification_send (n);
+        g_object_unref (n);
+
+        return TRUE;
+}
+
+static gboolean
+notify_rate_limit_release_cb (gpointer user_data);
+
+static void
+notify_rate_limit_schedule_release (NotifyRateLimit *limit)
+{
+        guint delay = 0;
+
+        if (limit->release_source != 0 ||
+            (limit->merged == 0 && g_queue_is_empty (&limit->queued)))
+                return;
+
+        if (limit->tokens < 1)
+                delay = (guint) ((1 - limit->tokens) * 1000 / limit->rate) + 1;
+
+        limit->release_source = g_timeout_add (delay,
+                                               notify_rate_limit_release_cb,
+                                               limit);
+}
+
+static gboolean
+notify_rate_limit_release_cb (gpointer user_data)
+{
+        NotifyRateLimit *limit = user_data;
+
+        limit->release_source = 0;
+        notify_rate_limit_refill (limit);
+
+        while (limit->tokens >= 1 && notify_rate_limit_release_one (limit)) {
+                limit->tokens -= 1;
+
+                /*
+                 * A category may use up the share of the whole process
+                 * as well; going into debt throttles what comes next.
+                 */
+                if (limit != _rate_limit && _rate_limit != NULL) {
+                        notify_rate_limit_refill (_rate_limit);
+                        _rate_limit->tokens -= 1;
+                }
+        }
+
+        notify_rate_limit_schedule_release (limit);
+
+        return FALSE;
+}
+
+static void
+notify_rate_limit_free (NotifyRateLimit *limit)
+{
+        /* Whatever was held back is not lost when a limit is lifted */
+        while (notify_rate_limit_release_one (limit))
+                ;
+
+        if (limit->release_source != 0)
+                g_source_remove (limit->release_source);
+
+        g_string_free (limit->merged_body, TRUE);
+        g_free (limit->category);
+        g_free (limit);
+}
+
+static void
+notify_rate_limit_hold_back (NotifyRateLimit    *limit,
+                             NotifyNotification *n)
+{
+        char *summary;
+        char *escaped;
+
+        switch (limit->policy) {
+        case NOTIFY_RATE_LIMIT_DROP_NEWEST:
+                limit->suppressed++;
+                break;
+
+        case NOTIFY_RATE_LIMIT_DROP_OLDEST:
+                /* Its latest state is what will be sent */
+                if (g_queue_find (&limit->queued, n) != NULL)
+                        break;
+
+                if (g_queue_get_length (&limit->queued) >= limit->burst) {
+                        g_object_unref (g_queue_pop_head (&limit->queued));
+                        limit->suppressed++;
+                }
+
+                g_queue_push_tail (&limit->queued, g_object_ref (n));
+                break;
+
+        case NOTIFY_RATE_LIMIT_MERGE:
+                if (limit->merged < NOTIFY_RATE_LIMIT_MERGED_LINES) {
+                        g_object_get (n, "summary", &summary, NULL);
+                        if (limit->merged_body->len > 0)
+                                g_string_append_c (limit->merged_body, '\n');
+
+                        /* Summaries are plain text, but bodies are markup */
+                        escaped = g_markup_escape_text (summary != NULL ? summary : "", -1);
+                        g_string_append (limit->merged_body, escaped);
+                        g_free (escaped);
+                        g_free (summary);
+                }
+
+                limit->merged++;
+                limit->suppressed++;
+                break;
+        }
+
+        notify_rate_limit_schedule_release (limit);
+}
+
+/* Whether @limit lets a notification through now */
+static gboolean
+notify_rate_limit_check (NotifyRateLimit *limit)
+{
+        notify_rate_limit_refill (limit);
+
+        /* Nothing overtakes the notifications that are already waiting */
+        return limit->tokens >= 1 &&
+               limit->merged == 0 &&
+               g_queue_is_empty (&limit->queued);
+}
+
+/*
+ * _notify_rate_limit_admit:
+ * @n: a #NotifyNotification about to be shown
+ *
+ * Takes a token for @n from the limits set with notify_set_rate_limit().
+ *
+ * Returns: %TRUE if @n may be sent now, or %FALSE if it was dropped,
+ *   queued or merged according to the policy of the exceeded limit
+ */
+gboolean
+_notify_rate_limit_admit (NotifyNotification *n)
+{
+        NotifyRateLimit *category_limit = NULL;
+        const char      *category;
+
+        if (_rate_limit == NULL && _category_rate_limits == NULL)
+                return TRUE;
+
+        category = _notify_notification_get_category (n);
+        if (category != NULL && _category_rate_limits != NULL)
+                category_limit = g_hash_table_lookup (_category_rate_limits,
+                                                      category);
+
+        if (category_limit != NULL && !notify_rate_limit_check (category_limit)) {
+                notify_rate_limit_hold_back (category_limit, n);
+                return FALSE;
+        }
+
+        if (_rate_limit != NULL) {
+                if (!notify_rate_limit_check (_rate_limit)) {
+                        notify_rate_limit_hold_back (_rate_limit, n);
+                        return FALSE;
+                }
+                _rate_limit->tokens -= 1;
+        }
+
+        if (category_limit != NULL)
+                category_limit->tokens -= 1;
+
+        return TRUE;
+}
+
+static void
+notify_rate_limit_forget (NotifyRateLimit    *limit,
+                          NotifyNotification *n)
+{
+        if (g_queue_remove (&limit->queued, n))
+                g_object_unref (n);
+}
+
+/*
+ * _notify_rate_limit_forget:
+ * @n: a #NotifyNotification
+ *
+ * Drops @n from the queues of the rate limits, when it is closed before
+ * it could be sent.
+ */
+void
+_notify_rate_limit_forget (NotifyNotification *n)
+{
+        GHashTableIter   iter;
+        NotifyRateLimit *limit;
+
+        if (_rate_limit != NULL)
+                notify_rate_limit_forget (_rate_limit, n);
+
+        if (_category_rate_limits == NULL)
+                return;
+
+        g_hash_table_iter_init (&iter, _category_rate_limits);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &limit))
+                notify_rate_limit_forget (limit, n);
+}
+
+/**
+ * notify_set_rate_limit:
+ * @category: (allow-none): the category the limit applies to, or %NULL to
+ *   limit all the notifications of the process
+ * @rate: the number of notifications allowed per second, or 0 to lift the
+ *   limit
+ * @burst: the number of notifications that may be sent at once after a
+ *   quiet period, or 0 to use @rate
+ * @policy: what to do with the notifications exceeding the limit
+ *
+ * Limits how fast notifications are sent to the server, protecting it
+ * from an application gone haywire. The limit is a token bucket: each
+ * notification sent uses a token, and tokens come back at @rate per
+ * second, up to @burst. A notification with a category set with
+ * notify_notification_set_category() must get through both the limit of
+ * its category, if any, and the limit of the whole process.
+ *
+ * notify_notification_show() and notify_notification_show_async() report
+ * success for the notifications held back by @policy; their number can
+ * be read with notify_get_suppressed_count(). Notifications queued by
+ * %NOTIFY_RATE_LIMIT_DROP_OLDEST or merged by %NOTIFY_RATE_LIMIT_MERGE
+ * are sent from the main loop, and failures doing so are logged.
+ *
+ * Limits can also be set with the LIBNOTIFY_RATE_LIMIT environment
+ * variable, read by notify_init(). It holds a list of limits separated
+ * by semicolons, each of the form [CATEGORY=]RATE[/BURST][,POLICY],
+ * where POLICY is drop-newest, drop-oldest or merge. For example,
+ * "10/20,drop-oldest;im.received=1,merge".
+ *
+ * Since: 0.8
+ */
+void
+notify_set_rate_limit (const char           *category,
+                       guint                 rate,
+                       guint                 burst,
+                       NotifyRateLimitPolicy policy)
+{
+        NotifyRateLimit *limit = NULL;
+        NotifyRateLimit *old_limit;
+
+        g_return_if_fail (category == NULL || *category != '\0');
+        g_return_if_fail (policy <= NOTIFY_RATE_LIMIT_MERGE);
+
+        if (rate > 0)
+                limit = notify_rate_limit_new (category, rate, burst, policy);
+
+        if (category == NULL) {
+                old_limit = _rate_limit;
+                _rate_limit = limit;
+        } else {
+                if (_category_rate_limits == NULL)
+                        _category_rate_limits = g_hash_table_new (g_str_hash,
+                                                                  g_str_equal);
+
+                old_limit = g_hash_table_lookup (_category_rate_limits, category);
+                if (old_limit != NULL)
+                        g_hash_table_remove (_category_rate_limits, category);
+                if (limit != NULL)
+                        g_hash_table_insert (_category_rate_limits,
+                                             limit->category,
+                                             limit);
+        }
+
+        if (old_limit != NULL) {
+                if (limit != NULL)
+                        limit->suppressed = old_limit->suppressed;
+                notify_rate_limit_free (old_limit);
+        }
+}
+
+/**
+ * notify_get_suppressed_count:
+ * @category: (allow-none): a category, or %NULL for the limit of the
+ *   whole process
+ *
+ * Gets how many notifications the limit set with notify_set_rate_limit()
+ * for @category kept from being sent, whether they were dropped or merged
+ * into a summary.
+ *
+ * Returns: the number of notifications suppressed, or 0 if there is no
+ *   such limit
+ *
+ * Since: 0.8
+ */
+guint
+notify_get_suppressed_count (const char *category)
+{
+        NotifyRateLimit *limit = NULL;
+
+        if (category == NULL)
+                limit = _rate_limit;
+        else if (_category_rate_limits != NULL)
+                limit = g_hash_table_lookup (_category_rate_limits, category);
+
+        return limit != NULL ? limit->suppressed : 0;
+}
+
+static gboolean
+notify_parse_rate_limit (const char *spec)
+{
+        NotifyRateLimitPolicy policy = NOTIFY_RATE_LIMIT_DROP_NEWEST;
+        char                 *category = NULL;
+        const char           *equal;
+        char                 *end;
+        guint                 rate;
+        guint                 burst = 0;
+        guint                 i;
+
+        equal = strchr (spec, '=');
+        if (equal != NULL) {
+                category = g_strndup (spec, equal - spec);
+                spec = equal + 1;
+        }
+
+        rate = strtoul (spec, &end, 10);
+        if (*end == '/')
+                burst = strtoul (end + 1, &end, 10);
+
+        if (*end == ',') {
+                for (i = 0; i < G_N_ELEMENTS (_rate_limit_policies); i++) {
+                        if (strcmp (end + 1, _rate_limit_policies[i].name) == 0)
+                                break;
+                }
+                if (i == G_N_ELEMENTS (_rate_limit_policies)) {
+                        g_free (category);
+                        return FALSE;
+                }
+                policy = _rate_limit_policies[i].policy;
+        } else if (*end != '\0') {
+                g_free (category);
+                return FALSE;
+        }
+
+        if (end == spec || rate == 0 || (category != NULL && *category == '\0')) {
+                g_free (category);
+                return FALSE;
+        }
+
+        notify_set_rate_limit (category, rate, burst, policy);
+        g_free (category);
+
+        return TRUE;
+}
+
+static void
+notify_parse_rate_limit_env (void)
+{
+        const char *env;
+        char      **specs;
+        char      **spec;
+
+        if (_rate_limit_env_parsed)
+                return;
+        _rate_limit_env_parsed = TRUE;
+
+        env = g_getenv ("LIBNOTIFY_RATE_LIMIT");
+        if (env == NULL)
+                return;
+
+        specs = g_strsplit (env, ";", -1);
+        for (spec = specs; *spec != NULL; spec++) {
+                if (**spec == '\0')
+                        continue;
+
+                if (!notify_parse_rate_limit (*spec))
+                        g_warning ("Ignoring invalid rate limit '%s' in LIBNOTIFY_RATE_LIMIT",
+                                   *spec);
+        }
+        g_strfreev (specs);
+}
+
+typedef struct
+{
+        gint64  last_seen;
+        guint32 id;
+} NotifyDuplicate;
+
+static NotifyDuplicateMode _duplicate_mode = NOTIFY_DUPLICATE_SHOW;
+static gint64              _duplicate_window = 0;
+static gint64              _duplicate_last_expiry = 0;
+static GHashTable         *_duplicates = NULL;
+
+/* Keys are compared by content, so hash the serialized data */
+static guint
+notify_duplicate_key_hash (gconstpointer key)
+{
+        const guchar *data = g_variant_get_data ((GVariant *) key);
+        gsize         size = g_variant_get_size ((GVariant *) key);
+        guint         hash = 5381;
+        gsize         i;
+
+        for (i = 0; i < size; i++)
+                hash = (hash << 5) + hash + data[i];
+
+        return hash;
+}
+
+static void
+notify_duplicates_expire (gint64 now)
+{
+        GHashTableIter   iter;
+        NotifyDuplicate *duplicate;
+
+        if (now - _duplicate_last_expiry < _duplicate_window)
+                return;
+        _duplicate_last_expiry = now;
+
+        g_hash_table_iter_init (&iter, _duplicates);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &duplicate)) {
+                if (now - duplicate->last_seen > _duplicate_window)
+                        g_hash_table_iter_remove (&iter);
+        }
+}
+
+/**
+ * notify_set_duplicate_mode:
+ * @mode: what to do with duplicate notifications
+ * @window: how long a notification is remembered after it was last shown,
+ *   in milliseconds
+ *
+ * Makes libnotify recognize notifications identical to one shown in the
+ * last @window milliseconds, for applications that emit the same alert
+ * over and over. Notifications are identical if they have the same
+ * summary, body, icon and hints, which includes their category and
+ * urgency. The window starts again each time such a notification is
+ * actually sent: duplicates suppressed, or held back by the rate limits
+ * of notify_set_rate_limit(), do not extend it. Notifications sent
+ * later on by the rate limits or the live mode are checked when they
+ * are sent.
+ *
+ * With %NOTIFY_DUPLICATE_SUPPRESS, notify_notification_show() reports
+ * success for duplicates without sending them. With
+ * %NOTIFY_DUPLICATE_REPLACE, a duplicate that has not been shown yet
+ * takes the ID of the notification it duplicates and updates it in place.
+ *
+ * Since: 0.8
+ */
+void
+notify_set_duplicate_mode (NotifyDuplicateMode mode,
+                           guint               window)
+{
+        g_return_if_fail (mode <= NOTIFY_DUPLICATE_REPLACE);
+
+        _duplicate_mode = mode;
+        _duplicate_window = (gint64) window * 1000;
+
+        if (_duplicates != NULL) {
+                g_hash_table_destroy (_duplicates);
+                _duplicates = NULL;
+        }
+
+        if (mode != NOTIFY_DUPLICATE_SHOW)
+                _duplicates = g_hash_table_new_full (notify_duplicate_key_hash,
+                                                     g_variant_equal,
+                                                     (GDestroyNotify) g_variant_unref,
+                                                     g_free);
+}
+
+gboolean
+_notify_duplicates_enabled (void)
+{
+        return _duplicate_mode != NOTIFY_DUPLICATE_SHOW;
+}
+
+/*
+ * _notify_duplicates_check:
+ * @key: the content of a notification about to be sent
+ * @replaces_id: (out): the ID of the notification to replace, or 0
+ *
+ * Looks @key up among the notifications shown within the window set with
+ * notify_set_duplicate_mode(). Nothing is recorded until the notification
+ * is actually sent, see _notify_duplicates_sent().
+ *
+ * Returns: %FALSE if the notification must not be sent
+ */
+gboolean
+_notify_duplicates_check (GVariant *key,
+                          guint32  *replaces_id)
+{
+        NotifyDuplicate *duplicate;
+        gint64           now;
+
+        *replaces_id = 0;
+
+        if (_duplicates == NULL)
+                return TRUE;
+
+        now = g_get_monotonic_time ();
+        notify_duplicates_expire (now);
+
+        duplicate = g_hash_table_lookup (_duplicates, key);
+        if (duplicate == NULL ||
+            now - duplicate->last_seen > _duplicate_window)
+                return TRUE;
+
+        if (_duplicate_mode == NOTIFY_DUPLICATE_SUPPRESS)
+                return FALSE;
+
+        *replaces_id = duplicate->id;
+
+        return TRUE;
+}
+
+/*
+ * _notify_duplicates_sent:
+ * @key: the key passed to _notify_duplicates_check()
+ * @id: the ID the server gave the notification
+ *
+ * Records that the notification with content @key was shown, once the
+ * rate limits let it through and the server accepted it.
+ */
+void
+_notify_duplicates_sent (GVariant *key,
+                         guint32   id)
+{
+        NotifyDuplicate *duplicate;
+
+        if (_duplicates == NULL)
+                return;
+
+        duplicate = g_hash_table_lookup (_duplicates, key);
+        if (duplicate == NULL) {
+                duplicate = g_new0 (NotifyDuplicate, 1);
+                g_hash_table_insert (_duplicates, g_variant_ref (key), duplicate);
+        }
+
+        duplicate->last_seen = g_get_monotonic_time ();
+        duplicate->id = id;
+}
+
+/* How many Notify calls may await their reply at once */
+#define NOTIFY_SEND_WINDOW              16
+#define NOTIFY_SEND_QUEUE_DEFAULT_DEPTH 256
+
+typedef struct
+{
+        NotifyNotification *notification;
+        GVariant           *params;
+        GUnixFDList        *fd_list;
+        GCancellable       *cancellable;
+        GAsyncReadyCallback callback;
+        gpointer            user_data;
+} NotifySend;
+
+/* One queue per NotifyUrgency */
+static GQueue _send_queues[NOTIFY_URGENCY_CRITICAL + 1] = {
+        G_QUEUE_INIT, G_QUEUE_INIT, G_QUEUE_INIT
+};
+static guint  _sends_in_flight = 0;
+static guint  _send_queue_depth = NOTIFY_SEND_QUEUE_DEFAULT_DEPTH;
+
+static void
+notify_send_free (NotifySend *send)
+{
+        g_object_unref (send->notification);
+        g_variant_unref (send->params);
+        if (send->fd_list != NULL)
+                g_object_unref (send->fd_list);
+        if (send->cancellable != NULL)
+                g_object_unref (send->cancellable);
+        g_free (send);
+}
+
+static void
+notify_send_reject (NotifySend *send)
+{
+        GTask *task;
+
+        task = g_task_new (NULL, NULL, send->callback, send->user_data);
+        g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                                 "Too many notifications are waiting to be sent");
+        g_object_unref (task);
+
+        notify_send_free (send);
+}
+
+static void
+notify_send_queue_pump (void);
+
+static void
+notify_send_cb (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+        NotifySend *send = user_data;
+
+        _sends_in_flight--;
+
+        send->callback (source, res, send->user_data);
+        notify_send_free (send);
+
+        notify_send_queue_pump ();
+}
+
+static void
+notify_send_start (NotifySend *send)
+{
+        _sends_in_flight++;
+        _notify_notification_start_notify (send->notification,
+                                           send->params,
+                                           send->fd_list,
+                                           send->cancellable,
+                                           notify_send_cb,
+                                           send);
+}
+
+static void
+notify_send_queue_pump (void)
+{
+        NotifySend *send;
+        int         urgency;
+
+        while (_sends_in_flight < NOTIFY_SEND_WINDOW) {
+                send = NULL;
+                for (urgency = NOTIFY_URGENCY_CRITICAL;
+                     urgency >= NOTIFY_URGENCY_LOW && send == NULL;
+                     urgency--)
+                        send = g_queue_pop_head (&_send_queues[urgency]);
+
+                if (send == NULL)
+                        return;
+
+                notify_send_start (send);
+        }
+}
+
+static NotifySend *
+notify_send_new (NotifyNotification *n,
+                 GCancellable       *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer            user_data)
+{
+        NotifySend *send;
+
+        send = g_new0 (NotifySend, 1);
+        send->notification = g_object_ref (n);
+        send->params = _notify_notification_build_notify (n, &send->fd_list);
+        send->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+        send->callback = callback;
+        send->user_data = user_data;
+
+        return send;
+}
+
+/*
+ * _notify_send_notify_now:
+ * @n: a #NotifyNotification
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback, finishing with _notify_call_finish()
+ * @user_data: the data to pass to @callback
+ *
+ * Sends @n right away, however many Notify calls are awaiting their
+ * reply. The call still counts against the window while it is in flight.
+ */
+void
+_notify_send_notify_now (NotifyNotification *n,
+                         GCancellable       *cancellable,
+                         GAsyncReadyCallback callback,
+                         gpointer            user_data)
+{
+        notify_send_start (notify_send_new (n, cancellable, callback, user_data));
+}
+
+/*
+ * _notify_queue_notify:
+ * @n: a #NotifyNotification
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback, finishing with _notify_call_finish()
+ * @user_data: the data to pass to @callback
+ *
+ * Sends @n right away if few enough Notify calls are awaiting their
+ * reply, and queues it by urgency otherwise. When the queue is full, a
+ * queued notification less urgent than @n is rejected to make room for
+ * it, or @n itself if there is none.
+ *
+ * The Notify call is built now, like the duplicate key of @n was, so a
+ * queued notification is sent as it was when shown.
+ */
+void
+_notify_queue_notify (NotifyNotification *n,
+                      GCancellable       *cancellable,
+                      GAsyncReadyCallback callback,
+                      gpointer            user_data)
+{
+        NotifySend    *send;
+        NotifySend    *victim = NULL;
+        NotifyUrgency  urgency;
+        int            lower;
+
+        send = notify_send_new (n, cancellable, callback, user_data);
+
+        if (_sends_in_flight < NOTIFY_SEND_WINDOW) {
+                notify_send_start (send);
+                return;
+        }
+
+        urgency = _notify_notification_get_urgency (n);
+
+        if (notify_get_send_queue_length () >= _send_queue_depth) {
+                for (lower = NOTIFY_URGENCY_LOW; lower < urgency && victim == NULL; lower++)
+                        victim = g_queue_pop_tail (&_send_queues[lower]);
+
+                if (victim == NULL) {
+                        notify_send_reject (send);
+                        return;
+                }
+
+                notify_send_reject (victim);
+        }
+
+        g_queue_push_tail (&_send_queues[urgency], send);
+}
+
+/**
+ * notify_set_send_queue_depth:
+ * @depth: the maximum number of notifications waiting to be sent
+ *
+ * libnotify has a bounded number of notifications awaiting a reply from
+ * the server at any time. Notifications shown asynchronously beyond that
+ * wait in a queue, the critical ones first, then the ones with normal
+ * urgency, then the others. This sets how many notifications may wait.
+ *
+ * Once the queue is full, notify_notification_show_async() fails with
+ * %G_IO_ERROR_WOULD_BLOCK, so that producers can back off when the server
+ * cannot keep up. A more urgent notification takes the place of the
+ * newest queued one of lower urgency, which fails the same way instead.
+ *
+ * The default depth is 256. Synchronous calls and notify_show_many() are
+ * not queued.
+ *
+ * Since: 0.8
+ */
+void
+notify_set_send_queue_depth (guint depth)
+{
+        _send_queue_depth = depth;
+}
+
+/**
+ * notify_get_send_queue_length:
+ *
+ * Gets how many notifications are waiting to be sent, for producers that
+ * want to slow down before the queue fills up.
+ *
+ * Returns: the number of queued notifications
+ *
+ * Since: 0.8
+ */
+guint
+notify_get_send_queue_length (void)
+{
+        guint length = 0;
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (_send_queues); i++)
+                length += g_queue_get_length (&_send_queues[i]);
+
+        return length;
+}
+
+/**
+ * notify_set_max_image_size:
+ * @size: the maximum width and height of images, in pixels, or 0 for no
+ *   limit
+ *
+ * Sets the size images set with notify_notification_set_image_from_pixbuf()
+ * are downscaled to. Notification servers show images at icon size, so
+ * sending them larger only costs memory and bus traffic. The default is
+ * 128 pixels.
+ *
+ * This applies to the images set afterwards.
+ *
+ * Since: 0.8
+ */
+void
+notify_set_max_image_size (guint size)
+{
+        _max_image_size = size;
+}
+
+/**
+ * notify_get_max_image_size:
+ *
+ * Gets the size set with notify_set_max_image_size().
+ *
+ * Returns: the maximum width and height of images, in pixels, or 0 for no
+ *   limit
+ *
+ * Since: 0.8
+ */
+guint
+notify_get_max_image_size (void)
+{
+        return _max_image_size;
+}
+
+/**
+ * notify_set_image_spill_threshold:
+ * @threshold: the size in bytes above which images are sent as files, or
+ *   0 to always send them inline
+ *
+ * Images set with notify_notification_set_image_from_pixbuf() are sent
+ * inline in the notification. When they are larger than @threshold, they
+ * are written as PNG files under the user runtime directory and sent by
+ * path instead, if the server supports image paths. The files are named
+ * after their content and shared between processes, so the same image is
+ * written once however many applications use it. A file is kept while a
+ * notification shown with it is on screen, until the server closes it or
+ * notify_uninit() is called, so that servers reading it late or keeping
+ * a history still find it. It is removed once no notification of any
+ * process uses it any more.
+ *
+ * This is disabled by default, since a server in another sandbox may not
+ * be able to read the files.
+ *
+ * Since: 0.8
+ */
+void
+notify_set_image_spill_threshold (gsize threshold)
+{
+        _image_spill_threshold = threshold;
+}
+
+/**
+ * notify_get_image_spill_threshold:
+ *
+ * Gets the size set with notify_set_image_spill_threshold().
+ *
+ * Returns: the size in bytes above which images are sent as files, or 0
+ *
+ * Since: 0.8
+ */
+gsize
+notify_get_image_spill_threshold (void)
+{
+        return _image_spill_threshold;
+}
+
+/**
+ * notify_set_notification_pool_size:
+ * @size: the number of notifications to keep for reuse, or 0 to keep none
+ *
+ * Lets the process keep up to @size notifications for reuse. When the last
+ * reference to a #NotifyNotification is dropped, it is reset with
+ * notify_notification_reset() and kept, instead of being freed, and
+ * notify_notification_new() hands it out again. This saves the cost of
+ * constructing and finalizing objects in processes that send many
+ * short-lived notifications. The pool is disabled by default.
+ *
+ * Notifications are only kept if they are plain #NotifyNotification
+ * instances. Their signal handlers are disconnected, but data attached
+ * with g_object_set_data() is not removed, so code using the pool must
+ * not attach any.
+ *
+ * Since: 0.8
+ */
+void
+notify_set_notification_pool_size (guint size)
+{
+        _notification_pool_size = size;
+        _notify_pool_drain (size);
+}
+
+/* Frees the pooled notifications beyond @size */
+static void
+_notify_pool_drain (guint size)
+{
+        guint               pool_size = _notification_pool_size;
+        NotifyNotification *n;
+        GList              *link;
+
+        /* Otherwise they would be kept again */
+        _notification_pool_size = size;
+
+        while (_notification_pool.length > size) {
+                link = g_queue_pop_head_link (&_notification_pool);
+                n = link->data;
+
+                /* Finalizing removes it from the active notifications */
+                _notify_cache_add_notification (n);
+                g_object_unref (n);
+        }
+
+        _notification_pool_size = pool_size;
+}
+
+/*
+ * _notify_pool_take:
+ *
+ * Returns: (transfer full): a reset notification from the pool, or %NULL
+ */
+NotifyNotification *
+_notify_pool_take (void)
+{
+        NotifyNotification *n;
+        GList              *link;
+
+        link = g_queue_pop_head_link (&_notification_pool);
+        if (link == NULL)
+                return NULL;
+
+        n = link->data;
+        _notify_cache_add_notification (n);
+
+        return n;
+}
+
+/*
+ * _notify_pool_has_room:
+ *
+ * Returns: whether a notification losing its last reference may be kept
+ */
+gboolean
+_notify_pool_has_room (void)
+{
+        return _notification_pool.length < _notification_pool_size;
+}
+
+/*
+ * _notify_pool_keep:
+ * @n: a reset notification
+ *
+ * Keeps a reference to @n in the pool. Pooled notifications are not
+ * active, so they reuse their node in the list of active notifications.
+ */
+void
+_notify_pool_keep (NotifyNotification *n)
+{
+        _notify_cache_remove_notification (n);
+        g_queue_push_head_link (&_notification_pool,
+                                _notify_notification_get_cache_link (g_object_ref (n)));
+}
+
+/*
+ * The active notifications are chained through a list node embedded in
+ * each notification, so adding and removing one never walks the list,
+ * while notify_uninit() still sees them in creation order.
+ */
+void
+_notify_cache_add_notification (NotifyNotification *n)
+{
+        GList *link = _notify_notification_get_cache_link (n);
+
+        link->data = n;
+        g_queue_push_tail_link (&_active_notifications, link);
+}
+
+void
+_notify_cache_remove_notification (NotifyNotification *n)
+{
+        g_queue_unlink (&_active_notifications,
+                        _notify_notification_get_cache_link (n));
+}
+
+/*
+ * _notify_register_notification:
+ * @n: a #NotifyNotification
+ * @id: the server-side ID of @n
+ *
+ * Makes @n the target of the NotificationClosed and ActionInvoked signals
+ * the server emits for @id. The signals are parsed once by their
+ * subscription callbacks and routed with a single table lookup, however
+ * many notifications are alive.
+ */
+void
+_notify_register_notification (NotifyNotification *n,
+                               guint32             id)
+{
+        if (_notifications_by_id == NULL)
+                _notifications_by_id = g_hash_table_new (g_direct_hash,
+                                                         g_direct_equal);
+
+        g_hash_table_insert (_notifications_by_id, GUINT_TO_POINTER (id), n);
+}
+
+void
+_notify_unregister_notification (NotifyNotification *n,
+                                 guint32             id)
+{
+        if (_notifications_by_id == NULL)
+                return;
+
+        /* Another notification may have been given the same ID since */
+        if (g_hash_table_lookup (_notifications_by_id, GUINT_TO_POINTER (id)) == n)
+                g_hash_table_remove (_notifications_by_id, GUINT_TO_POINTER (id));
+}
+
+/*
+ * _notify_set_signal_listener:
+ * @n: a #NotifyNotification
+ * @listening: whether @n needs the NotificationClosed and ActionInvoked
+ *   signals
+ *
+ * The server broadcasts these signals for the notifications of every
+ * application, and their IDs cannot be matched by the bus since argN
+ * match rules only apply to strings. We thus only subscribe to them while
+ * at least one notification is listening.
+ */
+void
+_notify_set_signal_listener (NotifyNotification *n,
+                             gboolean            listening)
+{
+        if (listening) {
+                if (_signal_listeners == NULL)
+                        _signal_listeners = g_hash_table_new (g_direct_hash,
+                                                              g_direct_equal);
+
+                g_hash_table_insert (_signal_listeners, n, n);
+        } else {
+                if (_signal_listeners == NULL ||
+                    !g_hash_table_remove (_signal_listeners, n))
+                        return;
+        }
+
+        _notify_update_signal_subscriptions ();
 }
@@ -30,7 +30,90 @@
 
 G_BEGIN_DECLS
 
+/**
+ * NotifyCapability:
+ * @NOTIFY_CAP_NONE: No capability.
+ * @NOTIFY_CAP_ACTION_ICONS: The server interprets action identifiers as
+ *   icon names.
+ * @NOTIFY_CAP_ACTIONS: The server supports actions.
+ * @NOTIFY_CAP_BODY: The server shows the body text.
+ * @NOTIFY_CAP_BODY_HYPERLINKS: The server supports hyperlinks in the body.
+ * @NOTIFY_CAP_BODY_IMAGES: The server supports images in the body.
+ * @NOTIFY_CAP_BODY_MARKUP: The server supports markup in the body.
+ * @NOTIFY_CAP_ICON_MULTI: The server can animate multiple icon frames.
+ * @NOTIFY_CAP_ICON_STATIC: The server shows a single icon frame.
+ * @NOTIFY_CAP_PERSISTENCE: The server keeps notifications until they are
+ *   acknowledged.
+ * @NOTIFY_CAP_SOUND: The server supports sounds.
+ *
+ * The standard capabilities a notification server may implement.
+ *
+ * Since: 0.8
+ */
+typedef enum
+{
+        NOTIFY_CAP_NONE            = 0,
+        NOTIFY_CAP_ACTION_ICONS    = 1 << 0,
+        NOTIFY_CAP_ACTIONS         = 1 << 1,
+        NOTIFY_CAP_BODY            = 1 << 2,
+        NOTIFY_CAP_BODY_HYPERLINKS = 1 << 3,
+        NOTIFY_CAP_BODY_IMAGES     = 1 << 4,
+        NOTIFY_CAP_BODY_MARKUP     = 1 << 5,
+        NOTIFY_CAP_ICON_MULTI      = 1 << 6,
+        NOTIFY_CAP_ICON_STATIC     = 1 << 7,
+        NOTIFY_CAP_PERSISTENCE     = 1 << 8,
+        NOTIFY_CAP_SOUND           = 1 << 9,
+} NotifyCapability;
+
+/**
+ * NotifyRateLimitPolicy:
+ * @NOTIFY_RATE_LIMIT_DROP_NEWEST: Drop the notifications shown while the
+ *   limit is exceeded.
+ * @NOTIFY_RATE_LIMIT_DROP_OLDEST: Queue the notifications shown while the
+ *   limit is exceeded and send them as the limit allows, dropping the
+ *   oldest ones when more are queued than the burst size.
+ * @NOTIFY_RATE_LIMIT_MERGE: Replace the notifications shown while the
+ *   limit is exceeded by a single notification summarizing them, sent as
+ *   soon as the limit allows.
+ *
+ * What to do with the notifications shown faster than the limit set with
+ * notify_set_rate_limit() allows.
+ *
+ * Since: 0.8
+ */
+typedef enum
+{
+        NOTIFY_RATE_LIMIT_DROP_NEWEST,
+        NOTIFY_RATE_LIMIT_DROP_OLDEST,
+        NOTIFY_RATE_LIMIT_MERGE,
+} NotifyRateLimitPolicy;
+
+/**
+ * NotifyDuplicateMode:
+ * @NOTIFY_DUPLICATE_SHOW: Show duplicate notifications like any other.
+ * @NOTIFY_DUPLICATE_SUPPRESS: Do not send duplicate notifications.
+ * @NOTIFY_DUPLICATE_REPLACE: Send duplicate notifications as updates of
+ *   the notification they duplicate, so no new bubble appears.
+ *
+ * What to do with notifications identical to one shown recently, as set
+ * with notify_set_duplicate_mode().
+ *
+ * Since: 0.8
+ */
+typedef enum
+{
+        NOTIFY_DUPLICATE_SHOW,
+        NOTIFY_DUPLICATE_SUPPRESS,
+        NOTIFY_DUPLICATE_REPLACE,
+} NotifyDuplicateMode;
+
 gboolean        notify_init (const char *app_name);
+void            notify_init_async (const char         *app_name,
+                                   GCancellable       *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer            user_data);
+gboolean        notify_init_finish (GAsyncResult *result,
+                                    GError      **error);
 void            notify_uninit (void);
 gboolean        notify_is_initted (void);
 
@@ -38,11 +121,67 @@ const char     *notify_get_app_name (void);
 void            notify_set_app_name (const char *app_name);
 
 GList          *notify_get_server_caps (void);
+void            notify_get_server_caps_async (GCancellable       *cancellable,
+                                              GAsyncReadyCallback callback,
+                                              gpointer            user_data);
+GList          *notify_get_server_caps_finish (GAsyncResult *result,
+                                               GError      **error);
+gboolean        notify_server_has_capability (NotifyCapability capability);
 
 gboolean        notify_get_server_info (char **ret_name,
                                         char **ret_vendor,
                                         char **ret_version,
                                         char **ret_spec_version);
+void            notify_get_server_info_async (GCancellable       *cancellable,
+                                              GAsyncReadyCallback callback,
+                                              gpointer            user_data);
+gboolean        notify_get_server_info_finish (GAsyncResult *result,
+                                               char        **ret_name,
+                                               char        **ret_vendor,
+                                               char        **ret_version,
+                                               char        **ret_spec_version,
+                                               GError      **error);
+
+void            notify_set_call_timeout (gint timeout);
+gint            notify_get_call_timeout (void);
+void            notify_set_adaptive_call_timeout (gboolean adaptive);
+
+void            notify_set_rate_limit (const char           *category,
+                                       guint                 rate,
+                                       guint                 burst,
+                                       NotifyRateLimitPolicy policy);
+guint           notify_get_suppressed_count (const char *category);
+
+void            notify_set_duplicate_mode (NotifyDuplicateMode mode,
+                                           guint               window);
+
+void            notify_set_send_queue_depth (guint depth);
+guint           notify_get_send_queue_length (void);
+
+void            notify_set_max_image_size (guint size);
+guint           notify_get_max_image_size (void);
+void            notify_set_image_spill_threshold (gsize threshold);
+gsize           notify_get_image_spill_threshold (void);
+
+void            notify_set_notification_pool_size (guint size);
+
+void            notify_show_many (NotifyNotification **notifications,
+                                  guint                n_notifications,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data);
+gboolean        notify_show_many_finish (GAsyncResult *result,
+                                         GPtrArray   **errors,
+                                         GError      **error);
+
+void            notify_close_many (NotifyNotification **notifications,
+                                   guint                n_notifications,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data);
+gboolean        notify_close_many_finish (GAsyncResult *result,
+                                          GPtrArray   **errors,
+                                          GError      **error);
 
 G_END_DECLS
 
@@ -0,0 +1,121 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * @file tests/test-bench-construction.c Benchmark: notification construction
+ *
+ * Measures the cost of creating, filling and dropping notifications, as
+ * high-frequency producers do, with and without the notification pool,
+ * and from a template.
+ * Nothing is sent to the server.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA  02111-1307, USA.
+ */
+
+#include <libnotify/notify.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ITERATIONS 100000
+#define POOL_SIZE          16
+
+static void
+action_cb (NotifyNotification *n,
+           char               *action,
+           gpointer            user_data)
+{
+}
+
+static void
+fill (NotifyNotification *n,
+      int                 i)
+{
+        notify_notification_set_urgency (n, NOTIFY_URGENCY_NORMAL);
+        notify_notification_set_category (n, "device.added");
+        notify_notification_set_hint_int32 (n, "value", i % 100);
+        notify_notification_add_action (n, "open", "Open", action_cb, NULL, NULL);
+}
+
+static void
+report (const char *what,
+        gint64      start_time,
+        int         iterations)
+{
+        gint64 elapsed = g_get_monotonic_time () - start_time;
+
+        printf ("%-24s %8.1f ms total, %6.2f us per notification\n",
+                what,
+                elapsed / 1000.0,
+                (double) elapsed / iterations);
+}
+
+int
+main (int argc, char *argv[])
+{
+        NotifyNotification *n;
+        NotifyTemplate     *template;
+        gint64              start_time;
+        int                 iterations = DEFAULT_ITERATIONS;
+        int                 i;
+
+        if (argc > 1)
+                iterations = MAX (atoi (argv[1]), 1);
+
+        if (!notify_init ("Construction Benchmark"))
+                exit (1);
+
+        start_time = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                n = notify_notification_new ("Device added", "USB drive", "drive-removable-media");
+                fill (n, i);
+                g_object_unref (n);
+        }
+        report ("new and unref:", start_time, iterations);
+
+        n = notify_notification_new ("Device added", NULL, NULL);
+        start_time = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                notify_notification_reset (n);
+                notify_notification_update (n, "Device added", "USB drive", "drive-removable-media");
+                fill (n, i);
+        }
+        report ("reset and update:", start_time, iterations);
+        g_object_unref (n);
+
+        notify_set_notification_pool_size (POOL_SIZE);
+        start_time = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                n = notify_notification_new ("Device added", "USB drive", "drive-removable-media");
+                fill (n, i);
+                g_object_unref (n);
+        }
+        report ("pooled new and unref:", start_time, iterations);
+
+        template = notify_template_new (NULL, "drive-removable-media");
+        notify_template_set_urgency (template, NOTIFY_URGENCY_NORMAL);
+        notify_template_set_category (template, "device.added");
+        notify_template_add_action (template, "open", "Open", action_cb, NULL, NULL);
+        start_time = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                n = notify_notification_new_from_template (template, "Device added", "USB drive");
+                notify_notification_set_hint_int32 (n, "value", i % 100);
+                g_object_unref (n);
+        }
+        report ("pooled from template:", start_time, iterations);
+        notify_template_unref (template);
+
+        notify_uninit ();
+
+        return 0;
+}
@@ -0,0 +1,110 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * @file tests/test-bench-memory.c Benchmark: memory per notification
+ *
+ * Creates many resident notifications with a typical set of hints and
+ * reports how much memory each one costs. Nothing is sent to the server.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA  02111-1307, USA.
+ */
+
+#include <libnotify/notify.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEFAULT_COUNT 10000
+
+/* Returns the resident set size of the process in bytes, or -1 */
+static gint64
+get_resident_size (void)
+{
+        FILE  *statm;
+        long   size;
+        long   resident;
+        int    n;
+
+        statm = fopen ("/proc/self/statm", "r");
+        if (statm == NULL)
+                return -1;
+
+        n = fscanf (statm, "%ld %ld", &size, &resident);
+        fclose (statm);
+        if (n != 2)
+                return -1;
+
+        return (gint64) resident * sysconf (_SC_PAGESIZE);
+}
+
+int
+main (int argc, char *argv[])
+{
+        NotifyNotification **notifications;
+        gint64               start_size;
+        gint64               end_size;
+        gint64               start_time;
+        gint64               elapsed;
+        int                  count = DEFAULT_COUNT;
+        int                  i;
+
+        if (argc > 1)
+                count = MAX (atoi (argv[1]), 1);
+
+        if (!notify_init ("Memory Benchmark"))
+                exit (1);
+
+        notifications = g_new (NotifyNotification *, count);
+
+        start_size = get_resident_size ();
+        start_time = g_get_monotonic_time ();
+
+        for (i = 0; i < count; i++) {
+                NotifyNotification *n;
+
+                n = notify_notification_new ("Build finished",
+                                             "All tests passed",
+                                             "dialog-information");
+                notify_notification_set_urgency (n, NOTIFY_URGENCY_LOW);
+                notify_notification_set_category (n, "transfer.complete");
+                notify_notification_set_hint (n, "resident",
+                                              g_variant_new_boolean (TRUE));
+                notify_notification_set_hint_string (n, "desktop-entry",
+                                                     "org.example.Builder");
+                notify_notification_set_hint_int32 (n, "value", i % 100);
+
+                notifications[i] = n;
+        }
+
+        elapsed = g_get_monotonic_time () - start_time;
+        end_size = get_resident_size ();
+
+        printf ("%d notifications with 5 hints\n", count);
+        printf ("%-24s %8.1f us per notification\n",
+                "construction:", (double) elapsed / count);
+        if (start_size >= 0 && end_size >= 0) {
+                printf ("%-24s %8.1f bytes per notification\n",
+                        "resident memory:",
+                        (double) (end_size - start_size) / count);
+        }
+
+        for (i = 0; i < count; i++)
+                g_object_unref (notifications[i]);
+        g_free (notifications);
+
+        notify_uninit ();
+
+        return 0;
+}
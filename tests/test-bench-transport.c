@@ -0,0 +1,114 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * @file tests/test-bench-transport.c Benchmark: D-Bus transport
+ *
+ * Measures what the transport to the notification server costs callers
+ * of libnotify: connecting, querying the server and showing and closing
+ * notifications. Only API that earlier releases have is used, so this
+ * builds against them too, to compare libnotify's old GDBusProxy path
+ * with its GDBusConnection one.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA  02111-1307, USA.
+ */
+
+#include <libnotify/notify.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ITERATIONS 1000
+
+static void
+report (const char *what,
+        gint64      start_time,
+        int         iterations)
+{
+        gint64 elapsed = g_get_monotonic_time () - start_time;
+
+        printf ("%-32s %8.1f ms total, %6.1f us per call\n",
+                what,
+                elapsed / 1000.0,
+                (double) elapsed / iterations);
+}
+
+static void
+free_caps (GList *caps)
+{
+        g_list_foreach (caps, (GFunc) g_free, NULL);
+        g_list_free (caps);
+}
+
+int
+main (int argc, char *argv[])
+{
+        NotifyNotification *n;
+        GList              *caps;
+        GError             *error = NULL;
+        gint64              start_time;
+        int                 iterations = DEFAULT_ITERATIONS;
+        int                 i;
+
+        if (argc > 1)
+                iterations = MAX (atoi (argv[1]), 1);
+
+        if (!notify_init ("Transport Benchmark"))
+                exit (1);
+
+        /* Connects, and activates the server if needed */
+        start_time = g_get_monotonic_time ();
+        caps = notify_get_server_caps ();
+        if (caps == NULL) {
+                fprintf (stderr, "failed to reach the notification server\n");
+                exit (1);
+        }
+        free_caps (caps);
+        report ("notify_get_server_caps: first", start_time, 1);
+
+        start_time = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++)
+                free_caps (notify_get_server_caps ());
+        report ("notify_get_server_caps: again", start_time, iterations);
+
+        start_time = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                if (!notify_get_server_info (NULL, NULL, NULL, NULL)) {
+                        fprintf (stderr, "failed to get the server information\n");
+                        exit (1);
+                }
+        }
+        report ("notify_get_server_info", start_time, iterations);
+
+        /* Updates of a single notification, not to flood the screen */
+        n = notify_notification_new ("Transport Benchmark", NULL, NULL);
+        start_time = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                if (!notify_notification_show (n, &error)) {
+                        fprintf (stderr, "failed to send notification: %s\n",
+                                 error->message);
+                        g_error_free (error);
+                        exit (1);
+                }
+        }
+        report ("notify_notification_show", start_time, iterations);
+
+        start_time = g_get_monotonic_time ();
+        notify_notification_close (n, NULL);
+        report ("notify_notification_close", start_time, 1);
+        g_object_unref (n);
+
+        notify_uninit ();
+
+        return 0;
+}
@@ -0,0 +1,327 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * @file tests/test-image-fd.c Unit test: images passed as file descriptors
+ *
+ * Runs a mock notification server on a private bus, advertising the
+ * x-libnotify-image-fd capability, and checks that images reach it as
+ * sealed memfds rather than in the message.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA  02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <libnotify/notify.h>
+#include <gio/gunixfdlist.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMAGE_SIZE  64
+#define IMAGE_COLOR 0x336699ff
+#define N_SHOWS     3
+
+static const char introspection_xml[] =
+        "<node>"
+        "  <interface name='org.freedesktop.Notifications'>"
+        "    <method name='GetCapabilities'>"
+        "      <arg type='as' direction='out'/>"
+        "    </method>"
+        "    <method name='GetServerInformation'>"
+        "      <arg type='s' direction='out'/>"
+        "      <arg type='s' direction='out'/>"
+        "      <arg type='s' direction='out'/>"
+        "      <arg type='s' direction='out'/>"
+        "    </method>"
+        "    <method name='Notify'>"
+        "      <arg type='s' direction='in'/>"
+        "      <arg type='u' direction='in'/>"
+        "      <arg type='s' direction='in'/>"
+        "      <arg type='s' direction='in'/>"
+        "      <arg type='s' direction='in'/>"
+        "      <arg type='as' direction='in'/>"
+        "      <arg type='a{sv}' direction='in'/>"
+        "      <arg type='i' direction='in'/>"
+        "      <arg type='u' direction='out'/>"
+        "    </method>"
+        "    <method name='CloseNotification'>"
+        "      <arg type='u' direction='in'/>"
+        "    </method>"
+        "  </interface>"
+        "</node>";
+
+static GMutex   lock;
+static GCond    ready_cond;
+static gboolean ready = FALSE;
+static int      received = 0;
+static int      failures = 0;
+static guint32  next_id = 1;
+
+static void
+fail (const char *message)
+{
+        fprintf (stderr, "server: %s\n", message);
+        failures++;
+}
+
+/* Checks the pixels behind the x-libnotify-image-fd hint */
+static void
+check_image (GDBusMethodInvocation *invocation,
+             GVariant              *hints)
+{
+        GVariant     *inline_image;
+        GUnixFDList  *fd_list;
+        struct stat   st;
+        const guint8 *pixels;
+        gint32        width, height, rowstride, bits_per_sample, channels;
+        gint32        handle;
+        gboolean      has_alpha;
+        int           fd;
+        int           x, y;
+
+        inline_image = g_variant_lookup_value (hints, "image-data", NULL);
+        if (inline_image != NULL) {
+                fail ("image sent inline although the fd transport is available");
+                g_variant_unref (inline_image);
+                return;
+        }
+
+        if (!g_variant_lookup (hints, "x-libnotify-image-fd", "(iiibiih)",
+                               &width, &height, &rowstride, &has_alpha,
+                               &bits_per_sample, &channels, &handle)) {
+                fail ("no x-libnotify-image-fd hint");
+                return;
+        }
+
+        fd_list = g_dbus_message_get_unix_fd_list (g_dbus_method_invocation_get_message (invocation));
+        if (fd_list == NULL || handle >= g_unix_fd_list_get_length (fd_list)) {
+                fail ("no file descriptor for the image");
+                return;
+        }
+
+        fd = g_unix_fd_list_get (fd_list, handle, NULL);
+        if (fd < 0 || fstat (fd, &st) != 0 ||
+            st.st_size < (off_t) rowstride * height) {
+                fail ("image file descriptor is too short");
+                if (fd >= 0)
+                        close (fd);
+                return;
+        }
+
+        if ((fcntl (fd, F_GET_SEALS) & F_SEAL_WRITE) == 0) {
+                fail ("image file descriptor is not sealed");
+                close (fd);
+                return;
+        }
+
+        pixels = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close (fd);
+        if (pixels == MAP_FAILED) {
+                fail ("cannot map the image");
+                return;
+        }
+
+        for (y = 0; y < height; y++) {
+                for (x = 0; x < width * channels; x += channels) {
+                        const guint8 *p = pixels + y * rowstride + x;
+
+                        if (p[0] != 0x33 || p[1] != 0x66 || p[2] != 0x99) {
+                                fail ("image pixels differ");
+                                munmap ((void *) pixels, st.st_size);
+                                return;
+                        }
+                }
+        }
+
+        munmap ((void *) pixels, st.st_size);
+}
+
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const char            *sender,
+                    const char            *object_path,
+                    const char            *interface_name,
+                    const char            *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+        static const char *caps[] = { "body", "x-libnotify-image-fd", NULL };
+        GVariant          *hints;
+        guint32            replaces_id;
+
+        if (strcmp (method_name, "GetCapabilities") == 0) {
+                g_dbus_method_invocation_return_value (invocation,
+                                                       g_variant_new ("(^as)", caps));
+        } else if (strcmp (method_name, "GetServerInformation") == 0) {
+                g_dbus_method_invocation_return_value (invocation,
+                                                       g_variant_new ("(ssss)",
+                                                                      "mock",
+                                                                      "libnotify",
+                                                                      "1.0",
+                                                                      "1.2"));
+        } else if (strcmp (method_name, "Notify") == 0) {
+                g_variant_get_child (parameters, 1, "u", &replaces_id);
+                hints = g_variant_get_child_value (parameters, 6);
+
+                g_mutex_lock (&lock);
+                check_image (invocation, hints);
+                received++;
+                g_mutex_unlock (&lock);
+
+                g_variant_unref (hints);
+                g_dbus_method_invocation_return_value (invocation,
+                                                       g_variant_new ("(u)",
+                                                                      replaces_id != 0 ? replaces_id : next_id++));
+        } else {
+                g_dbus_method_invocation_return_value (invocation, NULL);
+        }
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+        handle_method_call,
+        NULL,
+        NULL
+};
+
+static gpointer
+server_thread (gpointer user_data)
+{
+        const char      *address = user_data;
+        GMainContext    *context;
+        GMainLoop       *server_loop;
+        GDBusConnection *connection;
+        GDBusNodeInfo   *introspection;
+        GVariant        *result;
+
+        context = g_main_context_new ();
+        g_main_context_push_thread_default (context);
+
+        connection = g_dbus_connection_new_for_address_sync (address,
+                                                             G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                             G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                             NULL,
+                                                             NULL,
+                                                             NULL);
+        g_assert (connection != NULL);
+
+        introspection = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+        g_dbus_connection_register_object (connection,
+                                           "/org/freedesktop/Notifications",
+                                           introspection->interfaces[0],
+                                           &interface_vtable,
+                                           NULL,
+                                           NULL,
+                                           NULL);
+
+        result = g_dbus_connection_call_sync (connection,
+                                              "org.freedesktop.DBus",
+                                              "/org/freedesktop/DBus",
+                                              "org.freedesktop.DBus",
+                                              "RequestName",
+                                              g_variant_new ("(su)",
+                                                             "org.freedesktop.Notifications",
+                                                             0),
+                                              G_VARIANT_TYPE ("(u)"),
+                                              G_DBUS_CALL_FLAGS_NONE,
+                                              -1,
+                                              NULL,
+                                              NULL);
+        g_assert (result != NULL);
+        g_variant_unref (result);
+
+        g_mutex_lock (&lock);
+        ready = TRUE;
+        g_cond_signal (&ready_cond);
+        g_mutex_unlock (&lock);
+
+        server_loop = g_main_loop_new (context, FALSE);
+        g_main_loop_run (server_loop);
+
+        return NULL;
+}
+
+int
+main ()
+{
+        GTestDBus          *bus;
+        GdkPixbuf          *pixbuf;
+        NotifyNotification *n;
+        GError             *error = NULL;
+        int                 i;
+
+        bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+        g_test_dbus_up (bus);
+
+        g_thread_new ("mock-server",
+                      server_thread,
+                      (gpointer) g_test_dbus_get_bus_address (bus));
+
+        g_mutex_lock (&lock);
+        while (!ready)
+                g_cond_wait (&ready_cond, &lock);
+        g_mutex_unlock (&lock);
+
+        if (!notify_init ("Image FD Test"))
+                exit (1);
+
+        /* Images only go as memfds once the capabilities are cached */
+        g_list_free_full (notify_get_server_caps (), g_free);
+
+        pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8,
+                                 IMAGE_SIZE, IMAGE_SIZE);
+        gdk_pixbuf_fill (pixbuf, IMAGE_COLOR);
+
+        /* Each show passes the same memfd again */
+        for (i = 0; i < N_SHOWS; i++) {
+                n = notify_notification_new ("Image", "Passed as a memfd", NULL);
+                notify_notification_set_image_from_pixbuf (n, pixbuf);
+
+                if (!notify_notification_show (n, &error)) {
+                        fprintf (stderr, "failed to send notification: %s\n",
+                                 error->message);
+                        g_error_free (error);
+                        exit (1);
+                }
+
+                g_object_unref (n);
+        }
+
+        g_object_unref (pixbuf);
+        notify_uninit ();
+
+        g_mutex_lock (&lock);
+        if (received != N_SHOWS) {
+                fprintf (stderr, "server received %d of %d notifications\n",
+                         received, N_SHOWS);
+                failures++;
+        }
+        g_mutex_unlock (&lock);
+
+        /* The server thread still holds a connection to the bus */
+        g_test_dbus_stop (bus);
+
+        if (failures > 0)
+                return 1;
+
+        printf ("%d images received as file descriptors\n", N_SHOWS);
+
+        return 0;
+}
@@ -0,0 +1,88 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * @file tests/test-live-updates.c Unit test: rate-limited progress updates
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA  02111-1307, USA.
+ */
+
+#include <libnotify/notify.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N_STEPS     1000
+#define MAX_RATE    5
+
+static GMainLoop *loop;
+static int        step = 0;
+
+static gboolean
+progress_cb (gpointer user_data)
+{
+        NotifyNotification *n = NOTIFY_NOTIFICATION (user_data);
+        char               *body;
+
+        step++;
+
+        /* Shown a thousand times, but sent at most five times a second */
+        body = g_strdup_printf ("%d%% done", step * 100 / N_STEPS);
+        notify_notification_update (n, "Copying files", body, NULL);
+        notify_notification_set_hint_int32 (n, "value", step * 100 / N_STEPS);
+        g_free (body);
+
+        if (!notify_notification_show (n, NULL)) {
+                fprintf (stderr, "failed to send notification\n");
+                exit (1);
+        }
+
+        if (step == N_STEPS) {
+                g_main_loop_quit (loop);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static gboolean
+quit_cb (gpointer user_data)
+{
+        g_main_loop_quit (loop);
+        return FALSE;
+}
+
+int
+main ()
+{
+        NotifyNotification *n;
+
+        if (!notify_init ("Live Updates Test"))
+                exit (1);
+
+        loop = g_main_loop_new (NULL, FALSE);
+
+        n = notify_notification_new ("Copying files", "0% done", NULL);
+        notify_notification_set_max_update_rate (n, MAX_RATE);
+
+        g_timeout_add (2, progress_cb, n);
+        g_main_loop_run (loop);
+
+        /* Let the last update reach the server */
+        g_timeout_add (1000 / MAX_RATE + 100, quit_cb, NULL);
+        g_main_loop_run (loop);
+
+        g_object_unref (n);
+
+        return 0;
+}
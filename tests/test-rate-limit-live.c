@@ -0,0 +1,273 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * @file tests/test-rate-limit-live.c Unit test: live updates and rate limits
+ *
+ * Runs a mock notification server on a private bus and shows a live
+ * notification far more often than both its update rate and the rate
+ * limit of the process allow. The updates merged by the live mode must
+ * still take tokens, so the server receives no more than the rate limit.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA  02111-1307, USA.
+ */
+
+#include <libnotify/notify.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UPDATE_RATE  100
+#define LIMIT_RATE   2
+#define LIMIT_BURST  2
+#define DURATION_MS  1500
+
+static const char introspection_xml[] =
+        "<node>"
+        "  <interface name='org.freedesktop.Notifications'>"
+        "    <method name='GetCapabilities'>"
+        "      <arg type='as' direction='out'/>"
+        "    </method>"
+        "    <method name='GetServerInformation'>"
+        "      <arg type='s' direction='out'/>"
+        "      <arg type='s' direction='out'/>"
+        "      <arg type='s' direction='out'/>"
+        "      <arg type='s' direction='out'/>"
+        "    </method>"
+        "    <method name='Notify'>"
+        "      <arg type='s' direction='in'/>"
+        "      <arg type='u' direction='in'/>"
+        "      <arg type='s' direction='in'/>"
+        "      <arg type='s' direction='in'/>"
+        "      <arg type='s' direction='in'/>"
+        "      <arg type='as' direction='in'/>"
+        "      <arg type='a{sv}' direction='in'/>"
+        "      <arg type='i' direction='in'/>"
+        "      <arg type='u' direction='out'/>"
+        "    </method>"
+        "    <method name='CloseNotification'>"
+        "      <arg type='u' direction='in'/>"
+        "    </method>"
+        "  </interface>"
+        "</node>";
+
+static GMutex    lock;
+static GCond     ready_cond;
+static gboolean  ready = FALSE;
+static int       received = 0;
+
+static GMainLoop *loop;
+static gint64     start_time;
+static int        shown = 0;
+
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const char            *sender,
+                    const char            *object_path,
+                    const char            *interface_name,
+                    const char            *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+        static const char *caps[] = { "body", NULL };
+
+        if (strcmp (method_name, "GetCapabilities") == 0) {
+                g_dbus_method_invocation_return_value (invocation,
+                                                       g_variant_new ("(^as)", caps));
+        } else if (strcmp (method_name, "GetServerInformation") == 0) {
+                g_dbus_method_invocation_return_value (invocation,
+                                                       g_variant_new ("(ssss)",
+                                                                      "mock",
+                                                                      "libnotify",
+                                                                      "1.0",
+                                                                      "1.2"));
+        } else if (strcmp (method_name, "Notify") == 0) {
+                g_mutex_lock (&lock);
+                received++;
+                g_mutex_unlock (&lock);
+
+                /* A single notification, replaced by every update */
+                g_dbus_method_invocation_return_value (invocation,
+                                                       g_variant_new ("(u)", 1));
+        } else {
+                g_dbus_method_invocation_return_value (invocation, NULL);
+        }
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+        handle_method_call,
+        NULL,
+        NULL
+};
+
+static gpointer
+server_thread (gpointer user_data)
+{
+        const char      *address = user_data;
+        GMainContext    *context;
+        GMainLoop       *server_loop;
+        GDBusConnection *connection;
+        GDBusNodeInfo   *introspection;
+        GVariant        *result;
+
+        context = g_main_context_new ();
+        g_main_context_push_thread_default (context);
+
+        connection = g_dbus_connection_new_for_address_sync (address,
+                                                             G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                             G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                             NULL,
+                                                             NULL,
+                                                             NULL);
+        g_assert (connection != NULL);
+
+        introspection = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+        g_dbus_connection_register_object (connection,
+                                           "/org/freedesktop/Notifications",
+                                           introspection->interfaces[0],
+                                           &interface_vtable,
+                                           NULL,
+                                           NULL,
+                                           NULL);
+
+        result = g_dbus_connection_call_sync (connection,
+                                              "org.freedesktop.DBus",
+                                              "/org/freedesktop/DBus",
+                                              "org.freedesktop.DBus",
+                                              "RequestName",
+                                              g_variant_new ("(su)",
+                                                             "org.freedesktop.Notifications",
+                                                             0),
+                                              G_VARIANT_TYPE ("(u)"),
+                                              G_DBUS_CALL_FLAGS_NONE,
+                                              -1,
+                                              NULL,
+                                              NULL);
+        g_assert (result != NULL);
+        g_variant_unref (result);
+
+        g_mutex_lock (&lock);
+        ready = TRUE;
+        g_cond_signal (&ready_cond);
+        g_mutex_unlock (&lock);
+
+        server_loop = g_main_loop_new (context, FALSE);
+        g_main_loop_run (server_loop);
+
+        return NULL;
+}
+
+static gboolean
+update_cb (gpointer user_data)
+{
+        NotifyNotification *n = NOTIFY_NOTIFICATION (user_data);
+        char               *body;
+
+        body = g_strdup_printf ("Update %d", ++shown);
+        notify_notification_update (n, "Live", body, NULL);
+        g_free (body);
+
+        if (!notify_notification_show (n, NULL)) {
+                fprintf (stderr, "failed to send notification\n");
+                exit (1);
+        }
+
+        if (g_get_monotonic_time () - start_time >= DURATION_MS * 1000) {
+                g_main_loop_quit (loop);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static gboolean
+quit_cb (gpointer user_data)
+{
+        g_main_loop_quit (loop);
+        return FALSE;
+}
+
+int
+main ()
+{
+        GTestDBus          *bus;
+        NotifyNotification *n;
+        gint64              elapsed;
+        int                 allowed;
+        int                 failures = 0;
+
+        bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+        g_test_dbus_up (bus);
+
+        g_thread_new ("mock-server",
+                      server_thread,
+                      (gpointer) g_test_dbus_get_bus_address (bus));
+
+        g_mutex_lock (&lock);
+        while (!ready)
+                g_cond_wait (&ready_cond, &lock);
+        g_mutex_unlock (&lock);
+
+        if (!notify_init ("Live Rate Limit Test"))
+                exit (1);
+
+        notify_set_rate_limit (NULL, LIMIT_RATE, LIMIT_BURST,
+                               NOTIFY_RATE_LIMIT_DROP_NEWEST);
+
+        loop = g_main_loop_new (NULL, FALSE);
+
+        n = notify_notification_new ("Live", NULL, NULL);
+        notify_notification_set_max_update_rate (n, UPDATE_RATE);
+
+        start_time = g_get_monotonic_time ();
+        g_timeout_add (2, update_cb, n);
+        g_main_loop_run (loop);
+        elapsed = g_get_monotonic_time () - start_time;
+
+        /* Let the deferred updates reach the server */
+        g_timeout_add (1000 / UPDATE_RATE + 200, quit_cb, NULL);
+        g_main_loop_run (loop);
+
+        g_object_unref (n);
+
+        /* One more token may come back while the last update is sent */
+        allowed = LIMIT_BURST + (int) (LIMIT_RATE * elapsed / G_USEC_PER_SEC) + 1;
+
+        g_mutex_lock (&lock);
+        if (received > allowed) {
+                fprintf (stderr, "server received %d updates, the rate limit allows %d\n",
+                         received, allowed);
+                failures++;
+        }
+        g_mutex_unlock (&lock);
+
+        if (notify_get_suppressed_count (NULL) == 0) {
+                fprintf (stderr, "no update was held back by the rate limit\n");
+                failures++;
+        }
+
+        notify_uninit ();
+
+        /* The server thread still holds a connection to the bus */
+        g_test_dbus_stop (bus);
+
+        if (failures > 0)
+                return 1;
+
+        printf ("%d updates shown, %d sent within the rate limit\n",
+                shown, received);
+
+        return 0;
+}
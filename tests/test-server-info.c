@@ -56,5 +56,11 @@ main (int argc, char **argv)
         g_list_foreach (caps, (GFunc) g_free, NULL);
         g_list_free (caps);
 
+        /* Answered from the cache, without another round trip */
+        printf ("Actions:      %s\n",
+                notify_server_has_capability (NOTIFY_CAP_ACTIONS) ? "yes" : "no");
+        printf ("Body markup:  %s\n",
+                notify_server_has_capability (NOTIFY_CAP_BODY_MARKUP) ? "yes" : "no");
+
         return 0;
 }
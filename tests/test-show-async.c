@@ -0,0 +1,130 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * @file tests/test-show-async.c Unit test: non-blocking show
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA  02111-1307, USA.
+ */
+
+#include <libnotify/notify.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N_NOTIFICATIONS 5
+
+static GMainLoop *loop;
+static int        pending = N_NOTIFICATIONS;
+static int        failures = 0;
+
+static void
+show_cb (GObject      *source,
+         GAsyncResult *result,
+         gpointer      user_data)
+{
+        NotifyNotification *n = NOTIFY_NOTIFICATION (source);
+        GError             *error = NULL;
+        int                 id;
+
+        if (!notify_notification_show_finish (n, result, &error)) {
+                fprintf (stderr, "failed to send notification: %s\n",
+                         error->message);
+                g_error_free (error);
+                failures++;
+        } else {
+                g_object_get (n, "id", &id, NULL);
+                printf ("shown with id %d\n", id);
+        }
+
+        g_object_unref (n);
+
+        if (--pending == 0)
+                g_main_loop_quit (loop);
+}
+
+static void
+show_many_cb (GObject      *source,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+        NotifyNotification **batch = user_data;
+        GPtrArray           *errors = NULL;
+        GError              *error = NULL;
+        int                  i;
+
+        if (!notify_show_many_finish (result, &errors, &error)) {
+                fprintf (stderr, "failed to send batch: %s\n",
+                         error->message);
+                g_error_free (error);
+                failures++;
+        }
+
+        for (i = 0; i < N_NOTIFICATIONS; i++) {
+                if (errors == NULL || g_ptr_array_index (errors, i) == NULL)
+                        printf ("batch item %d shown\n", i);
+                g_object_unref (batch[i]);
+        }
+
+        if (errors != NULL)
+                g_ptr_array_unref (errors);
+
+        g_main_loop_quit (loop);
+}
+
+int
+main ()
+{
+        int i;
+
+        if (!notify_init ("Async Show Test"))
+                exit (1);
+
+        loop = g_main_loop_new (NULL, FALSE);
+
+        /* All requests are issued before any reply is waited for */
+        for (i = 0; i < N_NOTIFICATIONS; i++) {
+                NotifyNotification *n;
+                char               *body;
+
+                body = g_strdup_printf ("Notification %d of %d",
+                                        i + 1, N_NOTIFICATIONS);
+                n = notify_notification_new ("Async show", body, NULL);
+                g_free (body);
+
+                notify_notification_show_async (n, NULL, show_cb, NULL);
+        }
+
+        g_main_loop_run (loop);
+
+        /* The same, as a single batch */
+        {
+                NotifyNotification *batch[N_NOTIFICATIONS];
+
+                for (i = 0; i < N_NOTIFICATIONS; i++) {
+                        char *body;
+
+                        body = g_strdup_printf ("Batch item %d of %d",
+                                                i + 1, N_NOTIFICATIONS);
+                        batch[i] = notify_notification_new ("Batch show",
+                                                            body, NULL);
+                        g_free (body);
+                }
+
+                notify_show_many (batch, N_NOTIFICATIONS, NULL,
+                                  show_many_cb, batch);
+                g_main_loop_run (loop);
+        }
+
+        return failures == 0 ? 0 : 1;
+}
@@ -322,24 +322,18 @@ main (int argc, char *argv[])
 
         /* Parse actions */
         if (actions != NULL && !hint_error) {
-                GList *iter = notify_get_server_caps();
-                if (iter && g_list_length(iter)) {
-                        hint_error = TRUE;
-
-                        for (;iter != NULL; iter = iter->next) {
-                                if (strcasecmp(iter->data, "actions"))
-                                        continue;
-                                hint_error = FALSE;
-                                break;
-                        }
+                GList *caps = notify_get_server_caps ();
 
-                        g_list_free(iter);
-                        if (hint_error) {
-                                g_printerr(N_("Actions are not supported by this notifications server. Displaying non-interactively.\n"));
-                                wait = FALSE;
-                                goto err_cont;
-                        }
+                /* Only a server that listed its capabilities can lack one */
+                if (caps != NULL &&
+                    !notify_server_has_capability (NOTIFY_CAP_ACTIONS)) {
+                        g_list_free_full (caps, g_free);
+                        hint_error = TRUE;
+                        g_printerr(N_("Actions are not supported by this notifications server. Displaying non-interactively.\n"));
+                        wait = FALSE;
+                        goto err_cont;
                 }
+                g_list_free_full (caps, g_free);
 
                 gint    i = 0, l;
                 char    *action = NULL, *name = NULL;